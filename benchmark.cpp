@@ -0,0 +1,1298 @@
+/** \brief benchmarks of fibonacci_heap
+ *
+ * Usage: benchmark [--min-size N] [--max-size N] [--filter SUBSTRING] [--no-fork]
+ *
+ * Every benchmark is run for sizes 1e3, 1e4, ... up to --max-size (default 1e6,
+ * use 1e8 for the full suite if you have enough memory), both on fibonacci_heap
+ * and on std::priority_queue with lazy deletion as a baseline. Each run happens
+ * in a child process so that its peak resident set size can be measured.
+ *
+ * Results are written to standard output as CSV, one line per run:
+ * benchmark,implementation,size,operations,ns_per_op,peak_rss_kb,checksum
+ * The implementation is fibonacci_heap, or compact_fibonacci_heap for the
+ * *_compact benchmarks, or the baseline. The checksum only depends on the
+ * input, so the two implementations of the same workload must report the same
+ * value.
+ */
+#include "fibonacci.hpp"
+#include "fibonacci_concurrent.hpp"
+#include "fibonacci_coroutine.hpp"
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+/** \brief the result of a single run */
+struct result {
+	size_t operations = 0;
+	double seconds = 0;
+	uint64_t checksum = 0;
+};
+
+/** \brief measure the time spent in f */
+template <typename F>
+double timeit(F f) {
+	auto start = chrono::steady_clock::now();
+	f();
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double>(end-start).count();
+}
+
+/** \brief std::priority_queue ordered as a min heap */
+template <typename K, typename T>
+using min_queue = priority_queue<tuple<K,T>,vector<tuple<K,T>>,greater<tuple<K,T>>>;
+
+/** \brief random keys used by the micro benchmarks */
+vector<int> random_keys(size_t n, unsigned seed) {
+	default_random_engine rng(seed);
+	uniform_int_distribution<int> dist(0,numeric_limits<int>::max());
+	vector<int> keys(n);
+	for(int &k:keys)
+		k = dist(rng);
+	return keys;
+}
+
+// ===================== micro benchmarks =====================
+
+result fib_insert(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			fh.insert(keys[i],i);
+	});
+	r.operations = n;
+	r.checksum = fh.top().key();
+	return r;
+}
+
+result pq_insert(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	min_queue<int,int> pq;
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			pq.emplace(keys[i],i);
+	});
+	r.operations = n;
+	r.checksum = get<0>(pq.top());
+	return r;
+}
+
+/** \brief construct a heap from a range of key data pairs */
+result fib_build(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<tuple<int,int>> elements;
+	elements.reserve(n);
+	for(size_t i=0;i<n;i++)
+		elements.emplace_back(keys[i],i);
+	fibonacci_heap<int,int> fh;
+	result r;
+	r.seconds = timeit([&]{
+		fh.insert_range(elements.begin(),elements.end());
+	});
+	r.operations = n;
+	r.checksum = fh.top().key();
+	return r;
+}
+
+result pq_build(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<tuple<int,int>> elements;
+	elements.reserve(n);
+	for(size_t i=0;i<n;i++)
+		elements.emplace_back(keys[i],i);
+	min_queue<int,int> pq;
+	result r;
+	r.seconds = timeit([&]{
+		pq = min_queue<int,int>(elements.begin(),elements.end());
+	});
+	r.operations = n;
+	r.checksum = get<0>(pq.top());
+	return r;
+}
+
+result fib_top(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	for(size_t i=0;i<n;i++)
+		fh.insert(keys[i],i);
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			sum += fh.top().key();
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+result pq_top(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	min_queue<int,int> pq;
+	for(size_t i=0;i<n;i++)
+		pq.emplace(keys[i],i);
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			sum += get<0>(pq.top());
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+result fib_remove(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	for(size_t i=0;i<n;i++)
+		fh.insert(keys[i],i);
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		while(fh.size())
+			sum = sum*31+fh.remove().key();
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+result pq_remove(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	min_queue<int,int> pq;
+	for(size_t i=0;i<n;i++)
+		pq.emplace(keys[i],i);
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		while(!pq.empty()) {
+			sum = sum*31+get<0>(pq.top());
+			pq.pop();
+		}
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief drain the heap in batches of 64 elements */
+result fib_remove_batch(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	for(size_t i=0;i<n;i++)
+		fh.insert(keys[i],i);
+	result r;
+	uint64_t sum = 0;
+	vector<fibonacci_heap<int,int>::node> batch;
+	batch.reserve(64);
+	r.seconds = timeit([&]{
+		while(fh.size()) {
+			batch.clear();
+			fh.remove_top_k(64,back_inserter(batch));
+			for(auto &n:batch)
+				sum = sum*31+n.key();
+		}
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief there is no batch pop in std::priority_queue, so this is the same as pq_remove */
+result pq_remove_batch(size_t n) {
+	return pq_remove(n);
+}
+
+/** \brief decrease every key once, then drain the heap */
+result fib_decrease_key(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<int> deltas = random_keys(n,2);
+	fibonacci_heap<int,int> fh;
+	vector<fibonacci_heap<int,int>::node> nodes;
+	nodes.reserve(n);
+	for(size_t i=0;i<n;i++)
+		nodes.push_back(fh.insert(keys[i],i));
+	// remove one element so that the forest is consolidated into trees
+	fibonacci_heap<int,int>::node removed = fh.remove();
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			if(!(nodes[i]==removed))
+				fh.decrease_key(nodes[i],keys[i]-deltas[i]%(keys[i]/2+1));
+	});
+	r.operations = n;
+	uint64_t sum = 0;
+	while(fh.size())
+		sum = sum*31+fh.remove().key();
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the same as fib_decrease_key, but decrease_key is a push of duplicate
+ * and stale elements are skipped when popped */
+result pq_decrease_key(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<int> deltas = random_keys(n,2);
+	min_queue<int,int> pq;
+	vector<int> current = keys;
+	for(size_t i=0;i<n;i++)
+		pq.emplace(keys[i],i);
+	// keep the same set of elements as fib_decrease_key
+	vector<bool> removed(n,false);
+	removed[get<1>(pq.top())] = true;
+	pq.pop();
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++) {
+			if(removed[i]) continue;
+			current[i] = keys[i]-deltas[i]%(keys[i]/2+1);
+			pq.emplace(current[i],i);
+		}
+	});
+	r.operations = n;
+	uint64_t sum = 0;
+	while(!pq.empty()) {
+		int k = get<0>(pq.top());
+		int i = get<1>(pq.top());
+		pq.pop();
+		if(removed[i]||k!=current[i]) continue;
+		removed[i] = true;
+		sum = sum*31+k;
+	}
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the same as fib_insert, using compact_fibonacci_heap */
+result compact_insert(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	compact_fibonacci_heap<int,int> ch;
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			ch.insert(keys[i],i);
+	});
+	r.operations = n;
+	r.checksum = ch.key(ch.top());
+	return r;
+}
+
+/** \brief the same as fib_remove, using compact_fibonacci_heap */
+result compact_remove(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	compact_fibonacci_heap<int,int> ch;
+	for(size_t i=0;i<n;i++)
+		ch.insert(keys[i],i);
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		while(ch.size())
+			sum = sum*31+get<0>(ch.pop());
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the same as fib_decrease_key, using compact_fibonacci_heap */
+result compact_decrease_key(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<int> deltas = random_keys(n,2);
+	compact_fibonacci_heap<int,int> ch;
+	vector<uint32_t> ids;
+	ids.reserve(n);
+	for(size_t i=0;i<n;i++)
+		ids.push_back(ch.insert(keys[i],i));
+	uint32_t removed = ch.top();
+	ch.pop();
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			if(ids[i]!=removed)
+				ch.decrease_key(ids[i],keys[i]-deltas[i]%(keys[i]/2+1));
+	});
+	r.operations = n;
+	uint64_t sum = 0;
+	while(ch.size())
+		sum = sum*31+get<0>(ch.pop());
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief meld n single element heaps into one */
+result fib_meld(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<fibonacci_heap<int,int>> heaps(n);
+	for(size_t i=0;i<n;i++)
+		heaps[i].insert(keys[i],i);
+	fibonacci_heap<int,int> fh;
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++)
+			fh.meld(heaps[i]);
+	});
+	r.operations = n;
+	r.checksum = fh.top().key();
+	return r;
+}
+
+/** \brief std::priority_queue can not meld, so elements are pushed one by one */
+result pq_meld(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	vector<min_queue<int,int>> heaps(n);
+	for(size_t i=0;i<n;i++)
+		heaps[i].emplace(keys[i],i);
+	min_queue<int,int> pq;
+	result r;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++) {
+			for(;!heaps[i].empty();heaps[i].pop())
+				pq.push(heaps[i].top());
+		}
+	});
+	r.operations = n;
+	r.checksum = get<0>(pq.top());
+	return r;
+}
+
+/** \brief copy a consolidated heap, ns_per_op is per element, destroying the copy is not timed */
+result fib_copy(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	for(size_t i=0;i<n;i++)
+		fh.insert(keys[i],i);
+	fh.remove();
+	result r;
+	uint64_t sum = 0;
+	fibonacci_heap<int,int> copy;
+	r.seconds = timeit([&]{
+		copy = fh;
+	});
+	sum = copy.size();
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+result pq_copy(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	min_queue<int,int> pq;
+	for(size_t i=0;i<n;i++)
+		pq.emplace(keys[i],i);
+	pq.pop();
+	result r;
+	uint64_t sum = 0;
+	min_queue<int,int> copy;
+	r.seconds = timeit([&]{
+		copy = pq;
+	});
+	sum = copy.size();
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief restore a heap from a binary image in memory */
+result fib_load(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	for(size_t i=0;i<n;i++)
+		fh.insert(keys[i],i);
+	fh.remove();
+	ostringstream os(ios::binary);
+	fh.save(os);
+	istringstream is(os.str(),ios::binary);
+	result r;
+	fibonacci_heap<int,int> loaded;
+	r.seconds = timeit([&]{
+		loaded.load(is);
+	});
+	r.operations = n;
+	r.checksum = loaded.size();
+	return r;
+}
+
+/** \brief restore a priority queue from its underlying array in memory */
+result pq_load(size_t n) {
+	vector<int> keys = random_keys(n,1);
+	min_queue<int,int> pq;
+	for(size_t i=0;i<n;i++)
+		pq.emplace(keys[i],i);
+	pq.pop();
+	vector<tuple<int,int>> image;
+	image.reserve(pq.size());
+	for(min_queue<int,int> copy=pq;!copy.empty();copy.pop())
+		image.push_back(copy.top());
+	result r;
+	min_queue<int,int> loaded;
+	r.seconds = timeit([&]{
+		loaded = min_queue<int,int>(greater<tuple<int,int>>(),vector<tuple<int,int>>(image.begin(),image.end()));
+	});
+	r.operations = n;
+	r.checksum = loaded.size();
+	return r;
+}
+
+// ===================== workloads =====================
+
+/** \brief a directed graph in compressed sparse row format */
+struct graph {
+	vector<size_t> offsets;
+	vector<uint32_t> targets;
+	vector<uint32_t> weights;
+	size_t vertices() const { return offsets.size()-1; }
+};
+
+/** \brief build a graph in compressed sparse row format from an edge list */
+graph make_graph(size_t n, vector<tuple<uint32_t,uint32_t,uint32_t>> &edges) {
+	graph g;
+	g.offsets.assign(n+1,0);
+	for(auto &e:edges)
+		g.offsets[get<0>(e)+1]++;
+	for(size_t i=0;i<n;i++)
+		g.offsets[i+1] += g.offsets[i];
+	g.targets.resize(edges.size());
+	g.weights.resize(edges.size());
+	vector<size_t> pos(g.offsets.begin(),g.offsets.end()-1);
+	for(auto &e:edges) {
+		size_t p = pos[get<0>(e)]++;
+		g.targets[p] = get<1>(e);
+		g.weights[p] = get<2>(e);
+	}
+	return g;
+}
+
+/** \brief a square grid of about n vertices, with edges to 4 neighbours in both directions */
+graph grid_graph(size_t n) {
+	size_t side = max<size_t>(2,sqrt(double(n)));
+	default_random_engine rng(3);
+	uniform_int_distribution<uint32_t> weight(1,1000);
+	vector<tuple<uint32_t,uint32_t,uint32_t>> edges;
+	edges.reserve(4*side*side);
+	for(size_t i=0;i<side;i++) {
+		for(size_t j=0;j<side;j++) {
+			uint32_t v = i*side+j;
+			if(j+1<side) {
+				uint32_t w = weight(rng);
+				edges.emplace_back(v,v+1,w);
+				edges.emplace_back(v+1,v,w);
+			}
+			if(i+1<side) {
+				uint32_t w = weight(rng);
+				edges.emplace_back(v,v+side,w);
+				edges.emplace_back(v+side,v,w);
+			}
+		}
+	}
+	return make_graph(side*side,edges);
+}
+
+/** \brief a random undirected graph of n vertices and about 8n edges, connected by a random path */
+graph random_graph(size_t n) {
+	default_random_engine rng(4);
+	uniform_int_distribution<uint32_t> vertex(0,n-1);
+	uniform_int_distribution<uint32_t> weight(1,1000000);
+	vector<tuple<uint32_t,uint32_t,uint32_t>> edges;
+	edges.reserve(16*n);
+	for(size_t i=0;i+1<n;i++) {
+		uint32_t w = weight(rng);
+		edges.emplace_back(i,i+1,w);
+		edges.emplace_back(i+1,i,w);
+	}
+	for(size_t i=0;i<7*n;i++) {
+		uint32_t u = vertex(rng), v = vertex(rng), w = weight(rng);
+		edges.emplace_back(u,v,w);
+		edges.emplace_back(v,u,w);
+	}
+	return make_graph(n,edges);
+}
+
+/** \brief checksum of the distances computed by shortest path or spanning tree */
+uint64_t checksum(const vector<uint64_t> &dist) {
+	uint64_t sum = 0;
+	for(uint64_t d:dist)
+		sum = sum*31+d;
+	return sum;
+}
+
+constexpr uint64_t infinity = numeric_limits<uint64_t>::max();
+
+/** \brief Dijkstra's algorithm (prim==false) or Prim's algorithm (prim==true)
+ * using decrease_key of fibonacci_heap */
+result fib_search(const graph &g, bool prim) {
+	using fh_t = fibonacci_heap<uint64_t,uint32_t>;
+	size_t n = g.vertices();
+	vector<uint64_t> dist(n,infinity);
+	vector<fh_t::node> nodes(n);
+	vector<bool> done(n,false);
+	fh_t fh;
+	result r;
+	r.seconds = timeit([&]{
+		dist[0] = 0;
+		nodes[0] = fh.insert(0,0);
+		while(fh.size()) {
+			uint32_t u = fh.remove().data();
+			done[u] = true;
+			r.operations++;
+			for(size_t e=g.offsets[u];e<g.offsets[u+1];e++) {
+				uint32_t v = g.targets[e];
+				if(done[v]) continue;
+				uint64_t d = prim?g.weights[e]:dist[u]+g.weights[e];
+				if(d>=dist[v]) continue;
+				if(dist[v]==infinity)
+					nodes[v] = fh.insert(d,v);
+				else
+					fh.decrease_key(nodes[v],d);
+				dist[v] = d;
+				r.operations++;
+			}
+		}
+	});
+	r.checksum = checksum(dist);
+	return r;
+}
+
+/** \brief the same as fib_search, using indexed_fibonacci_heap */
+result indexed_search(const graph &g, bool prim) {
+	size_t n = g.vertices();
+	vector<uint64_t> dist(n,infinity);
+	vector<bool> done(n,false);
+	indexed_fibonacci_heap<uint64_t> ih(n);
+	result r;
+	r.seconds = timeit([&]{
+		dist[0] = 0;
+		ih.push(0,0);
+		while(ih.size()) {
+			uint32_t u = ih.pop();
+			done[u] = true;
+			r.operations++;
+			for(size_t e=g.offsets[u];e<g.offsets[u+1];e++) {
+				uint32_t v = g.targets[e];
+				if(done[v]) continue;
+				uint64_t d = prim?g.weights[e]:dist[u]+g.weights[e];
+				if(d>=dist[v]) continue;
+				if(dist[v]==infinity)
+					ih.push(v,d);
+				else
+					ih.decrease_key(v,d);
+				dist[v] = d;
+				r.operations++;
+			}
+		}
+	});
+	r.checksum = checksum(dist);
+	return r;
+}
+
+/** \brief the same as fib_search, using compact_fibonacci_heap */
+result compact_search(const graph &g, bool prim) {
+	using ch_t = compact_fibonacci_heap<uint64_t,uint32_t>;
+	size_t n = g.vertices();
+	vector<uint64_t> dist(n,infinity);
+	vector<uint32_t> ids(n);
+	vector<bool> done(n,false);
+	ch_t ch;
+	result r;
+	r.seconds = timeit([&]{
+		dist[0] = 0;
+		ids[0] = ch.insert(0,0);
+		while(ch.size()) {
+			uint32_t u = get<1>(ch.pop());
+			done[u] = true;
+			r.operations++;
+			for(size_t e=g.offsets[u];e<g.offsets[u+1];e++) {
+				uint32_t v = g.targets[e];
+				if(done[v]) continue;
+				uint64_t d = prim?g.weights[e]:dist[u]+g.weights[e];
+				if(d>=dist[v]) continue;
+				if(dist[v]==infinity)
+					ids[v] = ch.insert(d,v);
+				else
+					ch.decrease_key(ids[v],d);
+				dist[v] = d;
+				r.operations++;
+			}
+		}
+	});
+	r.checksum = checksum(dist);
+	return r;
+}
+
+/** \brief Dijkstra's algorithm (prim==false) or Prim's algorithm (prim==true)
+ * using std::priority_queue with lazy deletion */
+result pq_search(const graph &g, bool prim) {
+	size_t n = g.vertices();
+	vector<uint64_t> dist(n,infinity);
+	vector<bool> done(n,false);
+	min_queue<uint64_t,uint32_t> pq;
+	result r;
+	r.seconds = timeit([&]{
+		dist[0] = 0;
+		pq.emplace(0,0);
+		while(!pq.empty()) {
+			uint32_t u = get<1>(pq.top());
+			pq.pop();
+			if(done[u]) continue;
+			done[u] = true;
+			r.operations++;
+			for(size_t e=g.offsets[u];e<g.offsets[u+1];e++) {
+				uint32_t v = g.targets[e];
+				if(done[v]) continue;
+				uint64_t d = prim?g.weights[e]:dist[u]+g.weights[e];
+				if(d>=dist[v]) continue;
+				pq.emplace(d,v);
+				dist[v] = d;
+				r.operations++;
+			}
+		}
+	});
+	r.checksum = checksum(dist);
+	return r;
+}
+
+/** \brief parameters of the discrete event simulation */
+struct simulation {
+	size_t steps;
+	vector<double> delays;
+	vector<double> coins;
+	simulation(size_t n):steps(4*n),delays(5*n),coins(4*n) {
+		default_random_engine rng(5);
+		exponential_distribution<double> exp(1.0);
+		uniform_real_distribution<double> u01(0,1);
+		for(double &d:delays) d = exp(rng);
+		for(double &c:coins) c = u01(rng);
+	}
+};
+
+/** \brief hold model: n pending events, each step fires the earliest event and
+ * schedules a new one; with probability 1/4 a random pending event is cancelled
+ * and with probability 1/4 another one is rescheduled to an earlier time */
+result fib_events(size_t n) {
+	using fh_t = fibonacci_heap<double,uint32_t>;
+	simulation s(n);
+	fh_t fh;
+	vector<fh_t::node> events(n);
+	size_t next_delay = 0;
+	for(size_t i=0;i<n;i++)
+		events[i] = fh.insert(s.delays[next_delay++],i);
+	result r;
+	double now = 0;
+	uint64_t fired = 0;
+	r.seconds = timeit([&]{
+		for(size_t step=0;step<s.steps;step++) {
+			fh_t::node e = fh.remove();
+			now = e.key();
+			fired = fired*31+e.data();
+			uint32_t id = e.data();
+			double coin = s.coins[step];
+			uint32_t other = uint32_t(coin*n*4)%n;
+			if(coin<0.25 && other!=id) {
+				fh.remove(events[other]);
+				events[other] = fh.insert(now+s.delays[next_delay++%s.delays.size()],other);
+			} else if(coin<0.5 && other!=id && events[other].key()>now) {
+				fh.decrease_key(events[other],now+(events[other].key()-now)/2);
+			}
+			events[id] = fh.insert(now+s.delays[next_delay++%s.delays.size()],id);
+		}
+	});
+	r.operations = s.steps;
+	r.checksum = fired;
+	return r;
+}
+
+/** \brief the same simulation as fib_events, cancelled and rescheduled events are
+ * identified with a version number and skipped when popped */
+result pq_events(size_t n) {
+	simulation s(n);
+	priority_queue<tuple<double,uint32_t,uint64_t>,vector<tuple<double,uint32_t,uint64_t>>,greater<tuple<double,uint32_t,uint64_t>>> pq;
+	vector<uint64_t> version(n,0);
+	vector<double> time(n);
+	size_t next_delay = 0;
+	for(size_t i=0;i<n;i++) {
+		time[i] = s.delays[next_delay++];
+		pq.emplace(time[i],i,0);
+	}
+	result r;
+	double now = 0;
+	uint64_t fired = 0;
+	auto schedule = [&](uint32_t id, double t) {
+		time[id] = t;
+		pq.emplace(t,id,++version[id]);
+	};
+	r.seconds = timeit([&]{
+		for(size_t step=0;step<s.steps;step++) {
+			while(get<2>(pq.top())!=version[get<1>(pq.top())])
+				pq.pop();
+			now = get<0>(pq.top());
+			uint32_t id = get<1>(pq.top());
+			pq.pop();
+			fired = fired*31+id;
+			double coin = s.coins[step];
+			uint32_t other = uint32_t(coin*n*4)%n;
+			if(coin<0.25 && other!=id)
+				schedule(other,now+s.delays[next_delay++%s.delays.size()]);
+			else if(coin<0.5 && other!=id && time[other]>now)
+				schedule(other,now+(time[other]-now)/2);
+			schedule(id,now+s.delays[next_delay++%s.delays.size()]);
+		}
+	});
+	r.operations = s.steps;
+	r.checksum = fired;
+	return r;
+}
+
+// ===================== concurrency =====================
+
+/** \brief keys inserted by producer p of the concurrent benchmarks */
+vector<int> producer_keys(size_t n, size_t threads, size_t p) {
+	return random_keys(n/threads+(p<n%threads),10+p);
+}
+
+/** \brief threads producers insert n elements in total into concurrent_fibonacci_heap,
+ * while one consumer removes them */
+result fib_concurrent(size_t n, size_t threads) {
+	vector<vector<int>> keys(threads);
+	for(size_t p=0;p<threads;p++)
+		keys[p] = producer_keys(n,threads,p);
+	concurrent_fibonacci_heap<int,int> ch;
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		vector<thread> producers;
+		for(size_t p=0;p<threads;p++)
+			producers.emplace_back([&,p]{
+				for(int k:keys[p])
+					ch.insert(k,p);
+			});
+		int k, d;
+		for(size_t i=0;i<n;)
+			if(ch.try_pop(k,d)) {
+				sum += k;
+				i++;
+			}
+		for(thread &t:producers)
+			t.join();
+	});
+	r.operations = 2*n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the same as fib_concurrent, with a std::priority_queue behind a single mutex */
+result pq_concurrent(size_t n, size_t threads) {
+	vector<vector<int>> keys(threads);
+	for(size_t p=0;p<threads;p++)
+		keys[p] = producer_keys(n,threads,p);
+	min_queue<int,int> pq;
+	mutex lock;
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		vector<thread> producers;
+		for(size_t p=0;p<threads;p++)
+			producers.emplace_back([&,p]{
+				for(int k:keys[p]) {
+					lock_guard<mutex> guard(lock);
+					pq.emplace(k,p);
+				}
+			});
+		for(size_t i=0;i<n;) {
+			lock_guard<mutex> guard(lock);
+			if(pq.empty()) continue;
+			sum += get<0>(pq.top());
+			pq.pop();
+			i++;
+		}
+		for(thread &t:producers)
+			t.join();
+	});
+	r.operations = 2*n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the hold model on multi_fibonacci_heap: threads repeatedly remove an
+ * element and insert it back with a larger key, n operations in total on a heap
+ * of n elements. The order of removals is relaxed, so the checksum is the final size. */
+result fib_multi(size_t n, size_t threads) {
+	vector<int> keys = random_keys(n,1);
+	multi_fibonacci_heap<int,int> mh(threads);
+	for(size_t i=0;i<n;i++)
+		mh.push(keys[i]/2,i);
+	result r;
+	r.seconds = timeit([&]{
+		vector<thread> workers;
+		for(size_t t=0;t<threads;t++)
+			workers.emplace_back([&,t]{
+				vector<int> deltas = producer_keys(n,threads,t);
+				int k, d;
+				for(int delta:deltas)
+					if(mh.try_pop(k,d))
+						mh.push(k+delta/2,d);
+			});
+		for(thread &t:workers)
+			t.join();
+	});
+	r.operations = 2*n;
+	r.checksum = mh.size();
+	return r;
+}
+
+/** \brief the same as fib_multi, with a std::priority_queue behind a single mutex */
+result pq_multi(size_t n, size_t threads) {
+	vector<int> keys = random_keys(n,1);
+	min_queue<int,int> pq;
+	for(size_t i=0;i<n;i++)
+		pq.emplace(keys[i]/2,i);
+	mutex lock;
+	result r;
+	r.seconds = timeit([&]{
+		vector<thread> workers;
+		for(size_t t=0;t<threads;t++)
+			workers.emplace_back([&,t]{
+				vector<int> deltas = producer_keys(n,threads,t);
+				for(int delta:deltas) {
+					lock_guard<mutex> guard(lock);
+					tuple<int,int> e = pq.top();
+					pq.pop();
+					pq.emplace(get<0>(e)+delta/2,get<1>(e));
+				}
+			});
+		for(thread &t:workers)
+			t.join();
+	});
+	r.operations = 2*n;
+	r.checksum = pq.size();
+	return r;
+}
+
+/** \brief a small task of the executor benchmarks */
+uint64_t busy_work(uint64_t x) {
+	for(int i=0;i<100;i++) {
+		x ^= x<<13;
+		x ^= x>>7;
+		x ^= x<<17;
+	}
+	return x;
+}
+
+/** \brief a skewed workload on fibonacci_executor: a single task on one worker
+ * spawns n small tasks with random deadlines, the other workers have to steal them */
+result fib_executor(size_t n, size_t threads) {
+	vector<int> keys = random_keys(n,1);
+	atomic<uint64_t> sum{0};
+	result r;
+	fibonacci_executor<int> ex(threads);
+	r.seconds = timeit([&]{
+		ex.submit(0,[&]{
+			for(size_t i=0;i<n;i++)
+				ex.submit(keys[i],[&sum,i]{ sum += busy_work(i+1); });
+		});
+		ex.wait();
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the same as fib_executor, with a thread pool sharing a std::priority_queue behind a single mutex */
+result pq_executor(size_t n, size_t threads) {
+	vector<int> keys = random_keys(n,1);
+	atomic<uint64_t> sum{0};
+	result r;
+	r.seconds = timeit([&]{
+		min_queue<int,size_t> pq;
+		mutex lock;
+		atomic<size_t> finished{0};
+		vector<thread> workers;
+		for(size_t t=0;t<threads;t++)
+			workers.emplace_back([&,t]{
+				if(t==0) {
+					for(size_t i=0;i<n;i++) {
+						lock_guard<mutex> guard(lock);
+						pq.emplace(keys[i],i);
+					}
+				}
+				while(finished<n) {
+					size_t i;
+					{
+						lock_guard<mutex> guard(lock);
+						if(pq.empty()) continue;
+						i = get<1>(pq.top());
+						pq.pop();
+					}
+					sum += busy_work(i+1);
+					finished++;
+				}
+			});
+		for(thread &t:workers)
+			t.join();
+	});
+	r.operations = n;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief a writer inserts and removes n elements of published_fibonacci_heap
+ * while reader threads keep polling the top key and the size */
+result fib_published(size_t n, size_t readers) {
+	vector<int> keys = random_keys(n,1);
+	published_fibonacci_heap<int,int> ph;
+	atomic<bool> done{false};
+	atomic<uint64_t> reads{0};
+	vector<thread> threads;
+	for(size_t t=0;t<readers;t++)
+		threads.emplace_back([&]{
+			int k;
+			size_t size;
+			uint64_t count = 0;
+			while(!done) {
+				ph.observe(k,size);
+				count++;
+			}
+			reads += count;
+		});
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++) {
+			ph.insert(keys[i],i);
+			if(i%2)
+				sum = sum*31+get<0>(ph.pop());
+		}
+	});
+	done = true;
+	for(thread &t:threads)
+		t.join();
+	r.operations = n+n/2;
+	r.checksum = sum;
+	return r;
+}
+
+/** \brief the same as fib_published, with readers taking the lock of the writer to read top() */
+result locked_published(size_t n, size_t readers) {
+	vector<int> keys = random_keys(n,1);
+	fibonacci_heap<int,int> fh;
+	mutex lock;
+	atomic<bool> done{false};
+	vector<thread> threads;
+	for(size_t t=0;t<readers;t++)
+		threads.emplace_back([&]{
+			while(!done) {
+				lock_guard<mutex> guard(lock);
+				if(fh.size())
+					fh.top().key();
+			}
+		});
+	result r;
+	uint64_t sum = 0;
+	r.seconds = timeit([&]{
+		for(size_t i=0;i<n;i++) {
+			lock_guard<mutex> guard(lock);
+			fh.insert(keys[i],i);
+			if(i%2)
+				sum = sum*31+get<0>(fh.pop());
+		}
+	});
+	done = true;
+	for(thread &t:threads)
+		t.join();
+	r.operations = n+n/2;
+	r.checksum = sum;
+	return r;
+}
+
+// ===================== timers =====================
+
+/** \brief parameters of the timer benchmarks
+ *
+ * n timers are always armed, one per slot, with deadlines up to max_delay ticks
+ * ahead. In each of the ticks, random slots are rescheduled or cancelled and
+ * re-armed at the next tick, at least two ticks ahead, so that most timers never fire. A timer that fires is re-armed at a
+ * deadline derived from its slot and the tick, so both implementations see the
+ * same timers regardless of the order in which they fire within a tick.
+ */
+struct timer_workload {
+	static constexpr int max_delay = 10000;
+	static constexpr int ticks = 1000;
+	size_t n;
+	size_t ops_per_tick;
+	default_random_engine rng{7};
+	explicit timer_workload(size_t n):n(n),ops_per_tick(max<size_t>(1,4*n/ticks)) {}
+	int delay() { return uniform_int_distribution<int>(1,max_delay)(rng); }
+	size_t slot() { return uniform_int_distribution<size_t>(0,n-1)(rng); }
+	int op() { return uniform_int_distribution<int>(0,3)(rng); }
+	static int refire_delay(size_t slot, int now) { return 1+(slot*2654435761u+now*40503u)%max_delay; }
+};
+
+/** \brief timers as coroutines sleeping on fibonacci_scheduler, on a virtual clock */
+result fib_timers(size_t n) {
+	using sched_t = fibonacci_scheduler<>;
+	using ms = chrono::milliseconds;
+	timer_workload w(n);
+	sched_t::time_point t0;
+	vector<int> deadline(n);
+	vector<char> cancelled(n,0);
+	int now = 0;
+	uint64_t fired = 0, sum = 0;
+	vector<sched_t::token> tokens(n);
+	sched_t s;
+	auto timer = [&](size_t slot) -> fibonacci_task {
+		while(true) {
+			if(co_await s.sleep_until(t0+ms(deadline[slot]),&tokens[slot])) {
+				fired++;
+				sum += slot*now;
+				deadline[slot] = now+timer_workload::refire_delay(slot,now);
+			} else
+				cancelled[slot] = 0;
+		}
+	};
+	for(size_t i=0;i<n;i++) {
+		deadline[i] = w.delay();
+		timer(i);
+	}
+	result r;
+	r.seconds = timeit([&]{
+		for(int tick=0;tick<timer_workload::ticks;tick++) {
+			for(size_t i=0;i<w.ops_per_tick;i++) {
+				size_t slot = w.slot();
+				int op = w.op(), d = w.delay();
+				if(cancelled[slot] || op==3) continue;
+				if(op==2) {
+					tokens[slot].cancel();
+					cancelled[slot] = 1;
+					deadline[slot] = now+d+1;
+				} else {
+					tokens[slot].reschedule(t0+ms(now+d));
+					deadline[slot] = now+d;
+				}
+			}
+			now++;
+			// cancelled timers are resumed first, clear their flags and sleep again until deadline[slot]
+			s.run_expired(t0+ms(now));
+		}
+	});
+	r.operations = timer_workload::ticks*w.ops_per_tick;
+	r.checksum = fired*31+sum;
+	return r;
+}
+
+/** \brief the same as fib_timers, on a hashed timer wheel of 1024 buckets with intrusive lists */
+result wheel_timers(size_t n) {
+	constexpr size_t buckets = 1024;
+	constexpr uint32_t nil = numeric_limits<uint32_t>::max();
+	struct entry {
+		int deadline;
+		uint32_t prev, next;
+	};
+	timer_workload w(n);
+	vector<entry> timers(n);
+	vector<uint32_t> heads(buckets,nil);
+	vector<char> cancelled(n,0);
+	vector<size_t> rearm;
+	int now = 0;
+	uint64_t fired = 0, sum = 0;
+	auto link = [&](uint32_t i,int deadline) {
+		entry &e = timers[i];
+		uint32_t &head = heads[deadline%buckets];
+		e.deadline = deadline;
+		e.prev = nil;
+		e.next = head;
+		if(head!=nil) timers[head].prev = i;
+		head = i;
+	};
+	auto unlink = [&](uint32_t i) {
+		entry &e = timers[i];
+		if(e.prev!=nil) timers[e.prev].next = e.next;
+		else heads[e.deadline%buckets] = e.next;
+		if(e.next!=nil) timers[e.next].prev = e.prev;
+	};
+	vector<int> deadline(n);
+	for(size_t i=0;i<n;i++) {
+		deadline[i] = w.delay();
+		link(i,deadline[i]);
+	}
+	result r;
+	r.seconds = timeit([&]{
+		for(int tick=0;tick<timer_workload::ticks;tick++) {
+			for(size_t i=0;i<w.ops_per_tick;i++) {
+				size_t slot = w.slot();
+				int op = w.op(), d = w.delay();
+				if(cancelled[slot] || op==3) continue;
+				unlink(slot);
+				if(op==2) {
+					cancelled[slot] = 1;
+					rearm.push_back(slot);
+					deadline[slot] = now+d+1;
+				} else
+					link(slot,now+d);
+			}
+			now++;
+			for(size_t slot:rearm) {
+				link(slot,deadline[slot]);
+				cancelled[slot] = 0;
+			}
+			rearm.clear();
+			for(uint32_t i=heads[now%buckets];i!=nil;) {
+				uint32_t next = timers[i].next;
+				if(timers[i].deadline==now) {
+					unlink(i);
+					fired++;
+					sum += i*uint64_t(now);
+					link(i,now+timer_workload::refire_delay(i,now));
+				}
+				i = next;
+			}
+		}
+	});
+	r.operations = timer_workload::ticks*w.ops_per_tick;
+	r.checksum = fired*31+sum;
+	return r;
+}
+
+// ===================== driver =====================
+
+/** \brief a benchmark with its two implementations */
+struct benchmark {
+	string name;
+	function<result(size_t)> fib;
+	function<result(size_t)> pq;
+	string baseline = "priority_queue";
+	string implementation = "fibonacci_heap";
+};
+
+vector<benchmark> benchmarks = {
+	{ "insert", fib_insert, pq_insert },
+	{ "build", fib_build, pq_build },
+	{ "top", fib_top, pq_top },
+	{ "remove", fib_remove, pq_remove },
+	{ "remove_batch", fib_remove_batch, pq_remove_batch },
+	{ "decrease_key", fib_decrease_key, pq_decrease_key },
+	{ "insert_compact", compact_insert, pq_insert, "priority_queue", "compact_fibonacci_heap" },
+	{ "remove_compact", compact_remove, pq_remove, "priority_queue", "compact_fibonacci_heap" },
+	{ "decrease_key_compact", compact_decrease_key, pq_decrease_key, "priority_queue", "compact_fibonacci_heap" },
+	{ "meld", fib_meld, pq_meld },
+	{ "copy", fib_copy, pq_copy },
+	{ "load", fib_load, pq_load },
+	{ "dijkstra_grid", [](size_t n){ return fib_search(grid_graph(n),false); }, [](size_t n){ return pq_search(grid_graph(n),false); } },
+	{ "dijkstra_random", [](size_t n){ return fib_search(random_graph(n),false); }, [](size_t n){ return pq_search(random_graph(n),false); } },
+	{ "dijkstra_grid_indexed", [](size_t n){ return indexed_search(grid_graph(n),false); }, [](size_t n){ return pq_search(grid_graph(n),false); } },
+	{ "dijkstra_random_indexed", [](size_t n){ return indexed_search(random_graph(n),false); }, [](size_t n){ return pq_search(random_graph(n),false); } },
+	{ "dijkstra_random_compact", [](size_t n){ return compact_search(random_graph(n),false); }, [](size_t n){ return pq_search(random_graph(n),false); }, "priority_queue", "compact_fibonacci_heap" },
+	{ "prim_random", [](size_t n){ return fib_search(random_graph(n),true); }, [](size_t n){ return pq_search(random_graph(n),true); } },
+	{ "event_simulation", fib_events, pq_events },
+	{ "timers", fib_timers, wheel_timers, "timer_wheel" },
+	{ "concurrent_1", [](size_t n){ return fib_concurrent(n,1); }, [](size_t n){ return pq_concurrent(n,1); } },
+	{ "concurrent_2", [](size_t n){ return fib_concurrent(n,2); }, [](size_t n){ return pq_concurrent(n,2); } },
+	{ "concurrent_4", [](size_t n){ return fib_concurrent(n,4); }, [](size_t n){ return pq_concurrent(n,4); } },
+	{ "concurrent_8", [](size_t n){ return fib_concurrent(n,8); }, [](size_t n){ return pq_concurrent(n,8); } },
+	{ "concurrent_16", [](size_t n){ return fib_concurrent(n,16); }, [](size_t n){ return pq_concurrent(n,16); } },
+	{ "concurrent_32", [](size_t n){ return fib_concurrent(n,32); }, [](size_t n){ return pq_concurrent(n,32); } },
+	{ "concurrent_64", [](size_t n){ return fib_concurrent(n,64); }, [](size_t n){ return pq_concurrent(n,64); } },
+	{ "multi_1", [](size_t n){ return fib_multi(n,1); }, [](size_t n){ return pq_multi(n,1); } },
+	{ "multi_2", [](size_t n){ return fib_multi(n,2); }, [](size_t n){ return pq_multi(n,2); } },
+	{ "multi_4", [](size_t n){ return fib_multi(n,4); }, [](size_t n){ return pq_multi(n,4); } },
+	{ "multi_8", [](size_t n){ return fib_multi(n,8); }, [](size_t n){ return pq_multi(n,8); } },
+	{ "multi_16", [](size_t n){ return fib_multi(n,16); }, [](size_t n){ return pq_multi(n,16); } },
+	{ "multi_32", [](size_t n){ return fib_multi(n,32); }, [](size_t n){ return pq_multi(n,32); } },
+	{ "multi_64", [](size_t n){ return fib_multi(n,64); }, [](size_t n){ return pq_multi(n,64); } },
+	{ "executor_skewed_1", [](size_t n){ return fib_executor(n,1); }, [](size_t n){ return pq_executor(n,1); } },
+	{ "executor_skewed_2", [](size_t n){ return fib_executor(n,2); }, [](size_t n){ return pq_executor(n,2); } },
+	{ "executor_skewed_4", [](size_t n){ return fib_executor(n,4); }, [](size_t n){ return pq_executor(n,4); } },
+	{ "executor_skewed_8", [](size_t n){ return fib_executor(n,8); }, [](size_t n){ return pq_executor(n,8); } },
+	{ "executor_skewed_16", [](size_t n){ return fib_executor(n,16); }, [](size_t n){ return pq_executor(n,16); } },
+	{ "executor_skewed_32", [](size_t n){ return fib_executor(n,32); }, [](size_t n){ return pq_executor(n,32); } },
+	{ "executor_skewed_64", [](size_t n){ return fib_executor(n,64); }, [](size_t n){ return pq_executor(n,64); } },
+	{ "published_0", [](size_t n){ return fib_published(n,0); }, [](size_t n){ return locked_published(n,0); }, "locked_heap" },
+	{ "published_1", [](size_t n){ return fib_published(n,1); }, [](size_t n){ return locked_published(n,1); }, "locked_heap" },
+	{ "published_2", [](size_t n){ return fib_published(n,2); }, [](size_t n){ return locked_published(n,2); }, "locked_heap" },
+	{ "published_4", [](size_t n){ return fib_published(n,4); }, [](size_t n){ return locked_published(n,4); }, "locked_heap" },
+	{ "published_8", [](size_t n){ return fib_published(n,8); }, [](size_t n){ return locked_published(n,8); }, "locked_heap" },
+};
+
+/** \brief run f in a child process, return its result and peak RSS in KiB */
+tuple<result,long> run_isolated(function<result(size_t)> f, size_t n, bool isolate) {
+	if(!isolate) {
+		result r = f(n);
+		struct rusage usage;
+		getrusage(RUSAGE_SELF,&usage);
+		return make_tuple(r,usage.ru_maxrss);
+	}
+	int fds[2];
+	if(pipe(fds)!=0) throw "can not create pipe";
+	pid_t pid = fork();
+	if(pid<0) throw "can not fork";
+	if(pid==0) {
+		close(fds[0]);
+		result r = f(n);
+		ssize_t written = write(fds[1],&r,sizeof(r));
+		_exit(written==sizeof(r)?0:1);
+	}
+	close(fds[1]);
+	result r;
+	ssize_t got = read(fds[0],&r,sizeof(r));
+	close(fds[0]);
+	int status;
+	struct rusage usage;
+	wait4(pid,&status,0,&usage);
+	if(got!=sizeof(r)||!WIFEXITED(status)||WEXITSTATUS(status)!=0)
+		throw "benchmark process failed";
+	return make_tuple(r,usage.ru_maxrss);
+}
+
+int main(int argc, char **argv) {
+	size_t min_size = 1000;
+	size_t max_size = 1000000;
+	string filter;
+	bool isolate = true;
+	for(int i=1;i<argc;i++) {
+		string arg = argv[i];
+		if(arg=="--min-size"&&i+1<argc)
+			min_size = stod(argv[++i]);
+		else if(arg=="--max-size"&&i+1<argc)
+			max_size = stod(argv[++i]);
+		else if(arg=="--filter"&&i+1<argc)
+			filter = argv[++i];
+		else if(arg=="--no-fork")
+			isolate = false;
+		else {
+			cerr << "usage: " << argv[0] << " [--min-size N] [--max-size N] [--filter SUBSTRING] [--no-fork]" << endl;
+			return 1;
+		}
+	}
+	cout << "benchmark,implementation,size,operations,ns_per_op,peak_rss_kb,checksum" << endl;
+	for(benchmark &b:benchmarks) {
+		if(b.name.find(filter)==string::npos) continue;
+		for(size_t n=min_size;n<=max_size;n*=10) {
+			for(auto impl:{make_tuple(b.implementation,b.fib),make_tuple(b.baseline,b.pq)}) {
+				try {
+					auto out = run_isolated(get<1>(impl),n,isolate);
+					result &r = get<0>(out);
+					cout << b.name << "," << get<0>(impl) << "," << n << "," << r.operations << ","
+					     << r.seconds*1e9/max<size_t>(r.operations,1) << "," << get<1>(out) << "," << r.checksum << endl;
+				} catch(const char *e) {
+					cerr << b.name << "," << get<0>(impl) << "," << n << ": " << e << endl;
+				}
+			}
+		}
+	}
+}
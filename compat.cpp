@@ -0,0 +1,69 @@
+/** \file compat.cpp
+ * \brief Use the single-threaded parts of the library, to check that they compile
+ * and link under older language levels, see the compat target of the Makefile.
+ */
+#include "fibonacci.hpp"
+#include "fibonacci_mmap.hpp"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+int main() {
+	fibonacci_arena arena(16);
+	fibonacci_heap<int,int,less<int>,fibonacci_arena_allocator<int>> fa(arena);
+	for(int i=0;i<100;i++)
+		fa.insert(i,i);
+	fa.remove();
+
+	typedef fibonacci_heap<int,int,less<int>,allocator<int>,fibonacci_stats> fh_t;
+	fh_t fh;
+	vector<fh_t::node> nodes;
+	for(int i=0;i<100;i++)
+		nodes.push_back(fh.insert(i,i));
+	fh.set_consolidation_limit(8);
+	fh.remove();
+	fh.decrease_key(nodes[50],-1);
+	fh.update_key(nodes[60],200);
+	fh.remove(nodes[70]);
+	vector<fh_t::node> out;
+	fh.remove_top_k(3,back_inserter(out));
+	fh.extract_below(10,back_inserter(out));
+	fh_t copy = fh;
+	copy.split(fh,10);
+	fh.meld(copy);
+	fh_t::overlay snapshot = fh.snapshot();
+	snapshot.pop();
+	stringstream image;
+	fh.save(image);
+	fh_t loaded;
+	loaded.load(image);
+	ostringstream dot;
+	loaded.write_dot(dot);
+	if(loaded.stats().size!=fh.size() || fh.counters().cuts==0) return 1;
+
+	indexed_fibonacci_heap<int> ih(10);
+	for(int i=0;i<10;i++)
+		ih.push(i,10-i);
+	ih.pop();
+
+	compact_fibonacci_heap<int,int,less<int>,uint8_t> ch;
+	for(int i=0;i<100;i++)
+		ch.insert(i,i);
+	ch.pop();
+	ch.update_key(ch.top(),50);
+	ch.data(ch.top()) = 0;
+
+	const char *path = "compat.fib";
+	remove(path);
+	{
+		mapped_fibonacci_heap<int,int> mh(path);
+		mh.insert(1,1);
+		mh.flush();
+	}
+	remove(path);
+
+	cout << "ok" << endl;
+	return 0;
+}
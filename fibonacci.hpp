@@ -14,24 +14,274 @@
 #include <tuple>
 #include <initializer_list>
 #include <memory>
+#include <new>
 #include <cmath>
 #include <vector>
 #include <map>
 #include <string>
 #include <sstream>
 #include <tuple>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
 
-template <typename K, typename T, typename Compare>
+template <typename K, typename T, typename Compare, typename Allocator, typename Stats>
 class fibonacci_whitebox;
 
+template <typename K, typename Compare>
+class indexed_fibonacci_heap;
+
+/** \brief A memory arena for nodes of Fibonacci heaps
+ *
+ * Memory is carved out of large blocks obtained from the global heap, and
+ * freed chunks are kept in free lists (one per size class) to be reused by
+ * later allocations. All the blocks are returned to the global heap at once
+ * when the arena is destroyed or release() is called, so it is the user's
+ * responsibility to make sure that the arena outlives all the Fibonacci heaps
+ * and node objects using it.
+ *
+ * Use it through fibonacci_arena_allocator. The arena itself is not thread safe.
+ */
+class fibonacci_arena {
+
+	// only used by value, as a header can not define them out of line before C++17
+
+	/** \brief all chunks are multiples of this size and aligned to it */
+	static constexpr size_t granularity = alignof(std::max_align_t);
+
+	/** \brief the largest size of a single block obtained from the global heap, unless a larger chunk is requested */
+	static constexpr size_t max_block_size = size_t(64)<<20;
+
+	/** \brief a freed chunk, linked into the free list of its size class */
+	struct free_chunk {
+		free_chunk *next;
+	};
+
+	std::vector<free_chunk *> free_lists;
+	std::vector<void *> blocks;
+	char *cursor = nullptr;
+	size_t remaining = 0;
+	size_t next_block_size;
+	size_t total = 0;
+
+	/** \brief the size class of a chunk of the given size */
+	static size_t size_class(size_t bytes) {
+		return (std::max(bytes,sizeof(free_chunk))+granularity-1)/granularity;
+	}
+
+	/** \brief get a new block from the global heap that has at least the given size */
+	void grow(size_t bytes) {
+		size_t block_size = std::max(bytes,next_block_size);
+		cursor = static_cast<char *>(::operator new(block_size));
+		blocks.push_back(cursor);
+		remaining = block_size;
+		total += block_size;
+		next_block_size = std::min(2*next_block_size,size_t(max_block_size));
+	}
+
+public:
+
+	/** \brief Create an empty arena.
+	 *
+	 * @param initial_block_size size of the first block obtained from the global
+	 * heap, later blocks double in size up to 64MiB.
+	 */
+	explicit fibonacci_arena(size_t initial_block_size = 64*1024):next_block_size(std::max(initial_block_size,size_t(granularity))) {}
+
+	fibonacci_arena(const fibonacci_arena &) = delete;
+	fibonacci_arena &operator=(const fibonacci_arena &) = delete;
+
+	~fibonacci_arena() { release(); }
+
+	/** \brief Allocate a chunk of memory.
+	 *
+	 * @param bytes the size of the chunk
+	 * @param alignment the alignment of the chunk, must not exceed alignof(std::max_align_t)
+	 * @return pointer to the chunk
+	 */
+	void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+		if(alignment>granularity) throw "over-aligned types are not supported by fibonacci_arena";
+		size_t cls = size_class(bytes);
+		if(cls<free_lists.size() && free_lists[cls]) {
+			free_chunk *p = free_lists[cls];
+			free_lists[cls] = p->next;
+			return p;
+		}
+		size_t rounded = cls*granularity;
+		if(rounded>remaining) grow(rounded);
+		void *p = cursor;
+		cursor += rounded;
+		remaining -= rounded;
+		return p;
+	}
+
+	/** \brief Return a chunk to the free list of its size class.
+	 *
+	 * @param p pointer to the chunk, which must be allocated from this arena
+	 * @param bytes the size of the chunk, which must be the same as the size given to allocate()
+	 */
+	void deallocate(void *p, size_t bytes) {
+		size_t cls = size_class(bytes);
+		if(cls>=free_lists.size()) free_lists.resize(cls+1,nullptr);
+		free_chunk *c = static_cast<free_chunk *>(p);
+		c->next = free_lists[cls];
+		free_lists[cls] = c;
+	}
+
+	/** \brief Make sure that the given number of bytes can be allocated without going to the global heap again.
+	 *
+	 * @param bytes number of bytes to reserve
+	 */
+	void reserve(size_t bytes) {
+		if(bytes>remaining) grow(bytes);
+	}
+
+	/** \brief Return the number of bytes actually taken by a chunk of the given size.
+	 *
+	 * @param bytes the size of the chunk
+	 * @return the size of the chunk after rounding
+	 */
+	static size_t chunk_size(size_t bytes) { return size_class(bytes)*granularity; }
+
+	/** \brief Return all memory to the global heap at once.
+	 *
+	 * All the chunks allocated from this arena become invalid.
+	 */
+	void release() {
+		for(void *b:blocks)
+			::operator delete(b);
+		blocks.clear();
+		free_lists.clear();
+		cursor = nullptr;
+		remaining = 0;
+		total = 0;
+	}
+
+	/** \brief Return the number of bytes currently obtained from the global heap.
+	 *
+	 * @return number of bytes in all blocks
+	 */
+	size_t allocated_bytes() const { return total; }
+};
+
+/** \brief A standard allocator that allocates from a fibonacci_arena
+ *
+ * Copies of the allocator (including rebound ones) share the same arena.
+ * A default constructed allocator does not refer to any arena and can not be
+ * used to allocate memory.
+ *
+ * @param U the type of objects to allocate
+ */
+template <typename U>
+class fibonacci_arena_allocator {
+
+	template <typename V>
+	friend class fibonacci_arena_allocator;
+
+	fibonacci_arena *arena = nullptr;
+
+public:
+
+	using value_type = U;
+
+	fibonacci_arena_allocator() = default;
+
+	/** \brief create an allocator that allocates from the given arena */
+	fibonacci_arena_allocator(fibonacci_arena &arena):arena(&arena) {}
+
+	/** \brief create an allocator that share the arena with another allocator */
+	template <typename V>
+	fibonacci_arena_allocator(const fibonacci_arena_allocator<V> &old):arena(old.arena) {}
+
+	U *allocate(size_t n) { return static_cast<U *>(arena->allocate(n*sizeof(U),alignof(U))); }
+
+	/** \brief make sure that n single objects can be allocated from one contiguous block */
+	void reserve(size_t n) { arena->reserve(n*fibonacci_arena::chunk_size(sizeof(U))); }
+
+	void deallocate(U *p, size_t n) { arena->deallocate(p,n*sizeof(U)); }
+
+	template <typename V>
+	bool operator==(const fibonacci_arena_allocator<V> &rhs) const { return arena==rhs.arena; }
+
+	template <typename V>
+	bool operator!=(const fibonacci_arena_allocator<V> &rhs) const { return arena!=rhs.arena; }
+};
+
+/** \brief The default Stats policy of fibonacci_heap, which counts nothing
+ *
+ * A Stats policy is a class with the hooks below, which fibonacci_heap calls
+ * at the corresponding points of its algorithms. All the hooks here are empty
+ * and the class has no members, so they compile to nothing.
+ */
+struct fibonacci_no_stats {
+	/** \brief two keys are compared */
+	void compared() {}
+	/** \brief a tree is linked under another root during consolidation */
+	void linked() {}
+	/** \brief a node is cut from its parent because of a key change */
+	void cut() {}
+	/** \brief a cascading cut ends after cutting depth ancestors */
+	void cascaded(size_t /*depth*/) {}
+	/** \brief a root list of the given length is consolidated */
+	void consolidated(size_t /*roots*/) {}
+	/** \brief a node is allocated */
+	void allocated() {}
+};
+
+/** \brief A Stats policy of fibonacci_heap that counts operations
+ *
+ * Use it as the Stats template parameter of fibonacci_heap, and read the
+ * counters with fibonacci_heap::counters(). Counters are plain integers, so
+ * a copy of this struct is a snapshot of them.
+ */
+struct fibonacci_stats {
+	uint64_t comparisons = 0; ///< number of key comparisons
+	uint64_t links = 0; ///< number of trees linked under another root by consolidation
+	uint64_t cuts = 0; ///< number of nodes cut from their parents because of key changes
+	uint64_t cascading_cuts = 0; ///< number of ancestors cut by cascading cuts
+	uint64_t max_cascade_depth = 0; ///< the largest number of ancestors cut by one cascading cut
+	uint64_t consolidations = 0; ///< number of consolidations
+	uint64_t consolidated_roots = 0; ///< total length of the root lists consolidated
+	uint64_t max_root_list = 0; ///< the longest root list consolidated
+	uint64_t allocations = 0; ///< number of nodes allocated
+
+	void compared() { comparisons++; }
+	void linked() { links++; }
+	void cut() { cuts++; }
+	void cascaded(size_t depth) {
+		cascading_cuts += depth;
+		max_cascade_depth = std::max<uint64_t>(max_cascade_depth,depth);
+	}
+	void consolidated(size_t roots) {
+		consolidations++;
+		consolidated_roots += roots;
+		max_root_list = std::max<uint64_t>(max_root_list,roots);
+	}
+	void allocated() { allocations++; }
+};
+
 /** \brief A C++ implementation of Fibonacci heap
  *
  * @param K the type for keys
  * @param T the type for data
  * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Allocator the allocator used to allocate nodes, with default value std::allocator.
+ * It is rebound to the internal node type and must use raw pointers. Use
+ * fibonacci_arena_allocator to allocate nodes from a fibonacci_arena.
+ * @param Stats the policy that counts operations, with default value
+ * fibonacci_no_stats which counts nothing. Use fibonacci_stats to count
+ * operations, see counters().
  */
-template <typename K, typename T, typename Compare=std::less<K>>
-class fibonacci_heap {
+template <typename K, typename T, typename Compare=std::less<K>, typename Allocator=std::allocator<T>, typename Stats=fibonacci_no_stats>
+class fibonacci_heap : private Stats {
 
 public:
 	class node;
@@ -41,93 +291,192 @@ private:
 	/** To allow user defined test class to access private members of this class,
 	  * simply define the test class name as macro FIBONACCI_HEAP_TEST_FRIEND
 	  */
-	friend class fibonacci_whitebox<K,T,Compare>;
+	friend class fibonacci_whitebox<K,T,Compare,Allocator,Stats>;
+
+	template <typename, typename>
+	friend class indexed_fibonacci_heap;
 
-	class internal_structure;
-	class internal_data;
+	class internal_node;
 	// useful short for types
-	using ssp = std::shared_ptr<internal_structure>;
-	using swp = std::weak_ptr<internal_structure>;
-	using dsp = std::shared_ptr<internal_data>;
-	using dwp = std::weak_ptr<internal_data>;
+	using np = internal_node *;
+	using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<internal_node>;
+	using node_alloc_traits = std::allocator_traits<node_allocator>;
 
-	/** \brief the internal class responsible for the structure in Fibonacci heap
-	 * Structural information and data are stored to make it easier for std::shared_ptr
-	 * to automatically clean up memory without destroying user's pointer to data.
+	/** \brief the internal class used to store both structure and data in Fibonacci heap
+	 *
+	 * Structural information, key and data are stored in a single object so that
+	 * inserting an element costs exactly one allocation, and links between nodes
+	 * are raw pointers. The lifetime of a node is controlled by two things: whether
+	 * it is still inside a Fibonacci heap, and how many node objects refer to it.
+	 * A node is freed when it is neither in a heap nor referred to by a node object.
 	 */
-	class internal_structure {
+	class internal_node {
 	public:
+		internal_node(K key,const T &data):key(key),data(data) {}
+		internal_node(K key,T &&data):key(std::move(key)),data(std::move(data)) {}
+		template <typename... Args>
+		internal_node(std::piecewise_construct_t,K key,Args&&... args):key(std::move(key)),data(std::forward<Args>(args)...) {}
 		bool childcut = false;
+		bool in_heap = true;
 		size_t degree = 0;
-		dsp data;
-		ssp right_sibling;
-		swp left_sibling;
-		ssp child;
-		swp parent;
-		~internal_structure() {
-			data->structure.reset();
-			// cut loops inside child's sibling list so that std::shared_ptr can
-			// automatically free unneeded memory
-			if(child) child->right_sibling = nullptr;
-		}
-		static ssp make_single_tree_forest(dsp data) {
-			ssp ret = std::make_shared<internal_structure>();
-			ret->data = data;
-			data->structure = ret;
-			ret->right_sibling = ret;
-			ret->left_sibling = ret;
-			return ret;
-		}
-	};
-
-	/** \brief the interal class used to store data in Fibonacci heap */
-	class internal_data {
-	public:
-		internal_data(K key,const T &data):key(key),data(data) {}
-		internal_data(K key,T &&data):key(key),data(data) {}
-		internal_data(const internal_data &old) = default;
-		swp structure;
+		size_t handles = 0;
+		np right_sibling = this;
+		np left_sibling = this;
+		np child = nullptr;
+		np parent = nullptr;
 		K key;
 		T data;
 	};
 
-	/** \brief recursively duplicate nodes and create a new forest, including structure node and data node
-	 *
-	 * @param root the root node of the tree to be duplicated
-	 *
-	 * @param head used to denote what phase this function is doing. If head==nullptr,
-	 * then this function has just started at a doubly linked list; if head!=nullptr,
-	 * then this function is checking inside the doubly linked list and head is the first
-	 * element of the doubly linked list.
-	 *
-	 * @param newhead used only in the case when head!=nullptr, then newhead is
-	 * the pointer towards the duplicated node of head
-	 *
-	 * @return pointer to the node of the duplicated tree
-	 */
-	static ssp duplicate_nodes(std::shared_ptr<const internal_structure> root,std::shared_ptr<const internal_structure> head,ssp parent,ssp newhead) {
-		if(root==head) return nullptr;
-		ssp newroot = std::make_shared<internal_structure>(*root);
-		if(head==nullptr) {
-			head = root;
-			newhead = newroot;
-		}
-		// setup new data
-		dsp newroot_data = std::make_shared<internal_data>(*(root->data));
-		newroot_data->structure = newroot;
-		newroot->data = newroot_data;
-		// setup new right_sibling
-		newroot->right_sibling = duplicate_nodes(root->right_sibling, head, parent, newhead);
-		if(newroot->right_sibling==nullptr)
-			newroot->right_sibling = newhead;
-		// setup new left_sibling
-		newroot->right_sibling->left_sibling = newroot;
-		// setup new child
-		newroot->child = duplicate_nodes(root->child, nullptr, newroot, nullptr);
-		// setup new parent
-		newroot->parent = parent;
-		if(newroot->child) newroot->child->parent = newroot;
-		return newroot;
+	/** \brief allocate and construct a node using the allocator of this heap */
+	template <typename... Args>
+	np create_node(Args&&... args) {
+		np p = node_alloc_traits::allocate(alloc,1);
+		try {
+			node_alloc_traits::construct(alloc,p,std::forward<Args>(args)...);
+		} catch(...) {
+			node_alloc_traits::deallocate(alloc,p,1);
+			throw;
+		}
+		Stats::allocated();
+		return p;
+	}
+
+	/** \brief compare two keys, counting the comparison */
+	bool compare(const K &a,const K &b) {
+		Stats::compared();
+		return Compare()(a,b);
+	}
+
+	/** \brief destroy and deallocate a node using the given allocator */
+	static void destroy_node(node_allocator &alloc, np p) {
+		node_alloc_traits::destroy(alloc,p);
+		node_alloc_traits::deallocate(alloc,p,1);
+	}
+
+	/** \brief detach a node from the heap, free it if no node object refers to it */
+	void release_node(np p) {
+		p->in_heap = false;
+		if(p->handles==0) destroy_node(alloc,p);
+	}
+
+	/** \brief ask the allocator to prepare for n nodes, if it supports reserve() */
+	template <typename A>
+	static auto reserve_nodes(A &alloc, size_t n, int) -> decltype(alloc.reserve(n),void()) { alloc.reserve(n); }
+
+	template <typename A>
+	static void reserve_nodes(A &, size_t, long) {}
+
+	/** \brief reserve nodes for a range, only if its length can be known without consuming it */
+	template <typename InputIt>
+	void reserve_range(InputIt first, InputIt last, std::forward_iterator_tag) {
+		reserve_nodes(alloc,std::distance(first,last),0);
+	}
+
+	template <typename InputIt>
+	void reserve_range(InputIt, InputIt, std::input_iterator_tag) {}
+
+	/** \brief release every node in the forest whose root sibling list contains p
+	 *
+	 * The circular sibling list is opened into a chain, and the children of each
+	 * node are spliced into the chain right after it before it is released, so
+	 * that the whole forest is walked in a single loop using constant stack space,
+	 * no matter how long the root list is or how tall the trees are.
+	 */
+	void release_forest(np p) {
+		if(!p) return;
+		p->left_sibling->right_sibling = nullptr;
+		while(p) {
+			if(p->child) {
+				np c = p->child;
+				c->left_sibling->right_sibling = p->right_sibling;
+				p->right_sibling = c;
+				p->child = nullptr;
+			}
+			np next = p->right_sibling;
+			release_node(p);
+			p = next;
+		}
+	}
+
+	/** \brief duplicate a forest iteratively
+	 *
+	 * The source forest is walked in preorder by following child, right_sibling
+	 * and parent pointers, so no stack is needed. Each copy is appended to the
+	 * sibling list of its new parent (or to the new root list), which keeps the
+	 * order of siblings, and all links are rebuilt in this single traversal.
+	 * The allocator is asked to reserve n nodes up front if it supports
+	 * reserve(). If anything throws, the nodes copied so far are released.
+	 *
+	 * @param src any root of the forest to be duplicated
+	 *
+	 * @param n the number of nodes in the forest
+	 *
+	 * @param on_copy called as on_copy(old,new) with pointers to each source
+	 * node and its copy
+	 *
+	 * @return the copy of src
+	 */
+	template <bool Move=false,typename F>
+	np duplicate_forest(const internal_node *src,size_t n,F on_copy) {
+		if(!src) return nullptr;
+		reserve_nodes(alloc,n,0);
+		np newroot = nullptr;
+		np qparent = nullptr;
+		const internal_node *p = src;
+		try {
+			for(;;) {
+				np q = create_node(take<Move>(p->key),take<Move>(p->data));
+				q->childcut = p->childcut;
+				q->degree = p->degree;
+				q->parent = qparent;
+				np &head = qparent?qparent->child:newroot;
+				if(head) {
+					q->left_sibling = head->left_sibling;
+					q->right_sibling = head;
+					head->left_sibling->right_sibling = q;
+					head->left_sibling = q;
+				} else
+					head = q;
+				on_copy(p,q);
+				if(p->child) {
+					p = p->child;
+					qparent = q;
+					continue;
+				}
+				// go up until p has a right sibling that is not copied yet
+				while(p->right_sibling==(p->parent?p->parent->child:src)) {
+					p = p->parent;
+					if(!p) return newroot;
+					qparent = qparent->parent;
+				}
+				p = p->right_sibling;
+			}
+		} catch(...) {
+			release_forest(newroot);
+			throw;
+		}
+	}
+
+	/** \brief the key or data of a node being duplicated, moved out of it if Move is true */
+	template <bool Move,typename V>
+	static typename std::conditional<Move,V &&,const V &>::type take(const V &v) {
+		return static_cast<typename std::conditional<Move,V &&,const V &>::type>(const_cast<V &>(v));
+	}
+
+	/** \brief swap the forests of two Fibonacci heaps, and their allocators if Propagate is true */
+	void swap_forest(fibonacci_heap &other,std::true_type) {
+		using std::swap;
+		swap(this->alloc,other.alloc);
+		swap_forest(other,std::false_type());
+	}
+
+	void swap_forest(fibonacci_heap &other,std::false_type) {
+		std::swap(this->_size,other._size);
+		std::swap(this->min,other.min);
+		std::swap(this->trees,other.trees);
+		std::swap(this->root_limit,other.root_limit);
+		std::swap(this->new_roots,other.new_roots);
 	}
 
 	/** \brief Meld another forest to this Fibonacci heap.
@@ -161,40 +510,129 @@ private:
 	 * from target, in this case this parameter will be used. This parameter is
 	 * automatically ignored if target is not empty. Default value is nullptr.
 	 */
-	static void meld(ssp &target, ssp node, bool update_parent, bool find_min, bool set_min, bool reset_childcut, ssp parent=nullptr) {
+	void meld(np &target, np node, bool update_parent, bool find_min, bool set_min, bool reset_childcut, np parent=nullptr) {
 		if(!node) return;
-		if(target) parent = target->parent.lock();
+		if(target) parent = target->parent;
 		// update parent and find the min element
 		// if neither updating the parent nor the finding min, nor reseting childcut
 		// is needed, avoid this O(m) loop
 		if ( update_parent || find_min || reset_childcut ) {
-			ssp oldhead = node;
-			ssp p = oldhead;
+			np oldhead = node;
+			np p = oldhead;
 			do {
 				if(update_parent) p->parent = parent;
 				if(reset_childcut) p->childcut = false;
-				if(find_min && Compare()(p->data->key,node->data->key))
+				if(find_min && compare(p->key,node->key))
 					node = p;
 				p=p->right_sibling;
 			} while(p!=oldhead);
 		}
 		// merge sibling lists
 		if(target) {
-			target->right_sibling.swap(node->right_sibling);
-			target->right_sibling->left_sibling.swap(node->right_sibling->left_sibling);
-			if( set_min && Compare()(node->data->key,target->data->key) )
+			np target_right = target->right_sibling;
+			np node_right = node->right_sibling;
+			target->right_sibling = node_right;
+			node_right->left_sibling = target;
+			node->right_sibling = target_right;
+			target_right->left_sibling = node;
+			if( set_min && compare(node->key,target->key) )
 				target = node;
 		} else {
 			target = node;
 		}
 	}
 
-	/** \brief insert a data node */
-	node insert(dsp datanode) {
+	/** \brief insert a newly created node as a single tree forest */
+	node insert(np p) {
+		link_node(p);
+		return node(alloc,p);
+	}
+
+	/** \brief link a newly created node into the root list as a single tree */
+	void link_node(np p) {
 		_size++;
-		ssp p = internal_structure::make_single_tree_forest(datanode);
+		new_roots++;
 		meld(min,p,true,false,true,false);
-		return node(datanode);
+		limit_roots();
+	}
+
+	/** \brief consolidate if too many roots were added since the last consolidation
+	 *
+	 * This is called at the end of every operation that adds roots. The root list
+	 * then never has more than root_limit roots besides those left by the last
+	 * consolidation, so the next remove() has a bounded amount of linking to do.
+	 */
+	void limit_roots() {
+		if(root_limit && new_roots>root_limit && min) consolidate();
+	}
+
+	/** \brief decrease the key of a node in this heap, cut it from its parent if necessary */
+	void decrease_node_key(np ns,K new_key) {
+		np p = ns->parent;
+		ns->key = std::move(new_key);
+		if(p) {
+			if(compare(ns->key,p->key)) {
+				remove_tree(ns);
+				Stats::cut();
+				new_roots++;
+				meld(min,ns,true,false,true,false);
+				cascading_cut(p,min);
+				limit_roots();
+			}
+		} else if(compare(ns->key,min->key))
+			min = ns;
+	}
+
+	/** \brief increase the key of a node in this heap without moving it to another allocation
+	 *
+	 * The children of the node might now be smaller than it, so they are moved to
+	 * the root list. A node losing its children is treated like a node losing a
+	 * child in the cascading cut: if it is not a root, it is cut from its parent,
+	 * and a cascading cut is performed on the parent, so the degree bound of the
+	 * trees still holds.
+	 */
+	void increase_node_key(np ns,K new_key) {
+		bool was_min = (ns==min);
+		ns->key = std::move(new_key);
+		if(ns->child) {
+			new_roots += ns->degree;
+			meld(min,ns->child,true,true,true,false);
+			ns->child = nullptr;
+			ns->degree = 0;
+		}
+		np p = ns->parent;
+		if(p) {
+			remove_tree(ns);
+			Stats::cut();
+			new_roots++;
+			meld(min,ns,true,false,false,false);
+			cascading_cut(p,min);
+		} else if(was_min)
+			find_min();
+		limit_roots();
+	}
+
+	/** \brief Remove a node in this heap.
+	 *
+	 * The removed node is detached but not freed, the caller is responsible for
+	 * either handing it to a node object or freeing it.
+	 */
+	void remove_node(np p) {
+		if(p==min) {
+			remove_min();
+			return;
+		}
+		_size--;
+		// remove p from tree
+		remove_tree(p);
+		p->in_heap = false;
+		// insert p's child back
+		new_roots += p->degree;
+		if(p->child) meld(min,p->child,true,true,true,false);
+		// cascading cut
+		cascading_cut(p->parent,min);
+		p->child = nullptr;
+		limit_roots();
 	}
 
 	/** \brief Remove the subtree rooted at p.
@@ -203,56 +641,287 @@ private:
 	 * p are also updated so that p itself is a forest of one tree. p's parent pointer
 	 * and childcut are kept unchanged.
 	 */
-	void remove_tree(ssp p) {
-		if(!p->parent.expired()) {
-			ssp pp = p->parent.lock();
+	void remove_tree(np p) {
+		if(p->parent) {
+			np pp = p->parent;
 			pp->degree--;
 			if(pp->degree==0)
 				pp->child = nullptr;
 			else if(pp->child==p)
 				pp->child = p->right_sibling;
 		}
-		ssp &r = p->right_sibling;
-		ssp &lr = p->left_sibling.lock()->right_sibling;
-		swp &l = p->left_sibling;
-		swp &rl = p->right_sibling->left_sibling;
-		lr.swap(r);
-		rl.swap(l);
+		np l = p->left_sibling;
+		np r = p->right_sibling;
+		l->right_sibling = r;
+		r->left_sibling = l;
+		p->right_sibling = p;
+		p->left_sibling = p;
 	}
 
-	/** \brief cascading cut */
-	void cascading_cut(ssp p) {
-		if(p==nullptr) return;
-		ssp pp = p->parent.lock();
-		if(pp){
-			if(p->childcut){
-				remove_tree(p);
-				meld(min,p,true,false,true,false);
-				cascading_cut(pp);
-			} else
+	/** \brief count the nodes of the tree rooted at p, without recursion */
+	static size_t tree_size(np root) {
+		size_t count = 0;
+		np p = root;
+		while(true) {
+			count++;
+			if(p->child) {
+				p = p->child;
+				continue;
+			}
+			while(p!=root && p->right_sibling==p->parent->child)
+				p = p->parent;
+			if(p==root) break;
+			p = p->right_sibling;
+		}
+		return count;
+	}
+
+	/** \brief cascading cut
+	 *
+	 * @param p the node that just lost a child
+	 *
+	 * @param roots the sibling list that cut nodes are melded into, which is
+	 * usually the root list, but can also be a temporary list that will be melded
+	 * into the root list later
+	 */
+	void cascading_cut(np p,np &roots) {
+		size_t depth = 0;
+		while(p) {
+			np pp = p->parent;
+			if(!pp) break;
+			if(!p->childcut) {
 				p->childcut = true;
+				break;
+			}
+			remove_tree(p);
+			new_roots++;
+			meld(roots,p,true,false,true,false);
+			p = pp;
+			depth++;
+		}
+		Stats::cascaded(depth);
+	}
+
+	/** \brief Merge trees of same degrees in the root list.
+	 *
+	 * After this, all the roots have different degrees and min points to the
+	 * minimum root. min can point to any root before calling this method. The
+	 * member "trees" is used as scratch space indexed by degree, it only grows
+	 * and is left all nullptr, so that consolidation does not allocate after
+	 * the heap has warmed up.
+	 *
+	 * @return number of roots after consolidation
+	 */
+	size_t consolidate() {
+		new_roots = 0;
+		size_t max_degree_seen = 0;
+		size_t old_roots = 0;
+		while(min) {
+			old_roots++;
+			np q = min;
+			min = (q->right_sibling==q)?nullptr:q->right_sibling;
+			remove_tree(q);
+			for(;;) {
+				size_t d = q->degree;
+				if(d>=trees.size()) trees.resize(d+1,nullptr);
+				if(!trees[d]) break;
+				bool q_is_smaller = compare(q->key,trees[d]->key);
+				np smaller = q_is_smaller?q:trees[d];
+				np larger = q_is_smaller?trees[d]:q;
+				trees[d] = nullptr;
+				meld(smaller->child,larger,true,false,false,true,smaller);
+				smaller->degree++;
+				Stats::linked();
+				q = smaller;
+			}
+			trees[q->degree] = q;
+			max_degree_seen = std::max(max_degree_seen,q->degree);
+		}
+		Stats::consolidated(old_roots);
+
+		// meld trees of different degree back
+		size_t roots = 0;
+		for(size_t d=0;d<=max_degree_seen;d++) {
+			if(!trees[d]) continue;
+			meld(min,trees[d],false,false,true,false);
+			trees[d] = nullptr;
+			roots++;
+		}
+		return roots;
+	}
+
+	/** \brief visit nodes of the forest in preorder without recursion
+	 *
+	 * The forest is walked by following child, right_sibling and parent pointers,
+	 * so no stack is needed. f(p,prev,depth) is called for each node p, where prev
+	 * is the node visited before p in its sibling list (nullptr if p is the first)
+	 * and depth is 0 for roots.
+	 *
+	 * @param max_nodes stop after visiting this many nodes
+	 *
+	 * @param max_depth do not visit nodes whose depth is max_depth or more
+	 */
+	template <typename F>
+	void walk(size_t max_nodes,size_t max_depth,F f) const {
+		if(!min||!max_nodes||!max_depth) return;
+		np p = min;
+		np prev = nullptr;
+		size_t depth = 0;
+		for(size_t count=1;;count++) {
+			f(p,prev,depth);
+			if(count==max_nodes) return;
+			if(p->child && depth+1<max_depth) {
+				p = p->child;
+				prev = nullptr;
+				depth++;
+				continue;
+			}
+			// go up until p has a right sibling that is not visited yet
+			while(p->right_sibling==(p->parent?p->parent->child:min)) {
+				p = p->parent;
+				if(!p) return;
+				depth--;
+			}
+			prev = p;
+			p = p->right_sibling;
+		}
+	}
+
+	/** \brief point min to the minimum root by scanning the root list, without consolidation */
+	void find_min() {
+		np start = min;
+		np p = start;
+		do {
+			if(compare(p->key,min->key))
+				min = p;
+			p = p->right_sibling;
+		} while(p!=start);
+	}
+
+	/** \brief Take the top element out of the forest without consolidation.
+	 *
+	 * Children of the top element become roots, and min is left pointing to
+	 * any root (or nullptr if the heap becomes empty). The removed node is
+	 * detached but not freed, the caller is responsible for either handing it
+	 * to a node object or freeing it.
+	 *
+	 * @return the removed node
+	 */
+	np detach_min() {
+		if(_size==0) throw "no element to remove";
+		np oldmin = min;
+		_size--;
+		new_roots += oldmin->degree;
+		if(oldmin->child)
+			meld(min,oldmin->child,true,false,false,false);
+		min = (oldmin->right_sibling==oldmin)?nullptr:oldmin->right_sibling;
+		remove_tree(oldmin);
+		oldmin->child = nullptr;
+		oldmin->degree = 0;
+		oldmin->in_heap = false;
+		return oldmin;
+	}
+
+	/** \brief Remove the top element from the forest and consolidate.
+	 *
+	 * The removed node is detached but not freed, the caller is responsible for
+	 * either handing it to a node object or freeing it.
+	 *
+	 * @return the removed node
+	 */
+	np remove_min() {
+		np oldmin = detach_min();
+		if(min) consolidate();
+		return oldmin;
+	}
+
+	/** \brief Remove top elements while cond() holds and write node objects to out.
+	 *
+	 * The minimum of the remaining roots is found by scanning the root list, and
+	 * the roots are only consolidated when the root list has grown to twice the
+	 * length it had after the last consolidation, so that the cost of linking is
+	 * shared by the whole batch.
+	 */
+	template <typename Cond, typename OutputIt>
+	OutputIt remove_batch(Cond cond, OutputIt out) {
+		if(!min) return out;
+		size_t roots = consolidate();
+		size_t limit = 2*roots+1;
+		while(min && cond(min)) {
+			roots += min->degree;
+			roots--;
+			np oldmin = detach_min();
+			*out++ = node(alloc,oldmin);
+			if(!min) break;
+			if(roots>limit) {
+				roots = consolidate();
+				limit = 2*roots+1;
+			} else
+				find_min();
 		}
+		limit_roots();
+		return out;
 	}
 
+	/** \brief the header of images written by save() */
+	struct image_header {
+		char magic[8] = {'F','I','B','H','E','A','P','1'};
+		uint32_t byte_order = 0x01020304;
+		uint32_t key_size = sizeof(K);
+		uint32_t data_size = sizeof(T);
+		uint32_t reserved = 0;
+		uint64_t size = 0;
+	};
+
+	/** \brief bytes of each node in an image: key, data, degree and childcut */
+	static constexpr size_t image_record_size = sizeof(K)+sizeof(T)+2;
+
+	/** \brief bytes read or written at once when loading or saving an image */
+	static constexpr size_t image_buffer_size = 1<<16;
+
 	/** \brief calculate the max degree of nodes */
 	size_t max_degree() const {
 		return std::floor(std::log(_size)/std::log((std::sqrt(5.0)+1.0)/2.0));
 	}
 
-	ssp min;
+	node_allocator alloc;
+	np min = nullptr;
 	size_t _size = 0;
+	std::vector<np> trees;
+	/** \brief consolidate once more roots than this are added, 0 means never */
+	size_t root_limit = 0;
+	/** \brief number of roots added since the last consolidation, an upper bound */
+	size_t new_roots = 0;
 
 public:
 
 	/** \brief Create an empty Fibonacci heap. */
 	fibonacci_heap() = default;
 
+	/** \brief Create an empty Fibonacci heap that allocates nodes using the given allocator.
+	 * @param alloc the allocator
+	 */
+	explicit fibonacci_heap(const Allocator &alloc):alloc(alloc) {}
+
 	/** \brief Initialize a Fibonacci heap from list of key data pairs.
 	 * @param list the list of key data pairs
+	 * @param alloc the allocator used to allocate nodes
+	 */
+	fibonacci_heap(std::initializer_list<std::tuple<K,T>> list,const Allocator &alloc=Allocator()):alloc(alloc) {
+		insert_range(list.begin(),list.end());
+	}
+
+	/** \brief Initialize a Fibonacci heap from a range of key data pairs in O(n) time.
+	 *
+	 * See insert_range() for details.
+	 *
+	 * @param first the beginning of the range
+	 * @param last the end of the range
+	 * @param alloc the allocator used to allocate nodes
 	 */
-	fibonacci_heap(std::initializer_list<std::tuple<K,T>> list) {
-		for(auto &i:list)
-			insert(std::get<0>(i),std::get<1>(i));
+	template <typename InputIt>
+	fibonacci_heap(InputIt first,InputIt last,const Allocator &alloc=Allocator()):alloc(alloc) {
+		insert_range(first,last);
 	}
 
 	/** \brief the copy constructor.
@@ -266,7 +935,31 @@ public:
 	 *
 	 * @param old the Fibonacci heap to be copied
 	 */
-	fibonacci_heap(const fibonacci_heap &old):min(duplicate_nodes(old.min,nullptr,nullptr,nullptr)),_size(old._size) {}
+	fibonacci_heap(const fibonacci_heap &old):alloc(node_alloc_traits::select_on_container_copy_construction(old.alloc)),min(duplicate_forest(old.min,old._size,[](const internal_node *,np){})),_size(old._size),root_limit(old.root_limit),new_roots(old.new_roots) {}
+
+	/** \brief Make a deep copy and report which node of the copy corresponds to
+	 * which node of this Fibonacci heap.
+	 *
+	 * The copy is made the same way as the copy constructor. In addition,
+	 * f(old_node,new_node) is called for every element, where old_node is a node
+	 * object of this Fibonacci heap and new_node is the node object of the same
+	 * element in the copy, so that node objects held by the user can be
+	 * translated to the copy.
+	 *
+	 * @param f the function called for every pair of corresponding nodes
+	 * @return the copy
+	 */
+	template <typename F>
+	fibonacci_heap copy(F f) const {
+		fibonacci_heap ret(node_alloc_traits::select_on_container_copy_construction(alloc));
+		ret.min = ret.duplicate_forest(min,_size,[&](const internal_node *o,np n) {
+			f(node(alloc,const_cast<np>(o)),node(ret.alloc,n));
+		});
+		ret._size = _size;
+		ret.root_limit = root_limit;
+		ret.new_roots = new_roots;
+		return ret;
+	}
 
 	/** \brief the move constructor.
 	 *
@@ -275,26 +968,64 @@ public:
 	 *
 	 * @param old the Fibonacci heap to move data from
 	 */
-	fibonacci_heap(fibonacci_heap &&old):min(old.min),_size(old._size) {
+	fibonacci_heap(fibonacci_heap &&old):Stats(old),alloc(old.alloc),min(old.min),_size(old._size),trees(std::move(old.trees)),root_limit(old.root_limit),new_roots(old.new_roots) {
 		old.min = nullptr;
 		old._size = 0;
+		old.new_roots = 0;
 	}
 
 	~fibonacci_heap() {
-		// cut loops inside the forest list so that std::shared_ptr can
-		// automatically free unneeded memory
-		if(min) min->right_sibling = nullptr;
+		release_forest(min);
 	}
 
-	/** \brief the assignment operator, using copy-and-swap idiom
+	/** \brief the copy assignment operator, using copy-and-swap idiom
+	 *
+	 * The allocator of "old" is only taken if the allocator propagates on copy
+	 * assignment, otherwise the copy is allocated by the allocator of this heap.
 	 *
 	 * @param old the Fibonacci heap to be copied
 	 *
 	 * @return reference to this object
 	 */
-	fibonacci_heap& operator = (fibonacci_heap old) {
-		std::swap(this->_size,old._size);
-		this->min.swap(old.min);
+	fibonacci_heap& operator = (const fibonacci_heap &old) {
+		if(this==&old) return *this;
+		typename node_alloc_traits::propagate_on_container_copy_assignment propagate;
+		fibonacci_heap copy(propagate ? Allocator(old.alloc) : Allocator(alloc));
+		copy.min = copy.duplicate_forest(old.min,old._size,[](const internal_node *,np){});
+		copy._size = old._size;
+		copy.root_limit = old.root_limit;
+		copy.new_roots = old.new_roots;
+		swap_forest(copy,propagate);
+		return *this;
+	}
+
+	/** \brief the move assignment operator
+	 *
+	 * The nodes of "old" are taken over if its allocator propagates on move
+	 * assignment or is equal to the allocator of this heap, then node objects of
+	 * "old" can be used with this heap. Otherwise the elements are moved one by
+	 * one into new nodes allocated by the allocator of this heap, and node
+	 * objects of "old" keep the moved-from elements.
+	 *
+	 * @param old the Fibonacci heap to move data from
+	 *
+	 * @return reference to this object
+	 */
+	fibonacci_heap& operator = (fibonacci_heap &&old) {
+		if(this==&old) return *this;
+		typename node_alloc_traits::propagate_on_container_move_assignment propagate;
+		if(!propagate && !(alloc==old.alloc)) {
+			fibonacci_heap moved((Allocator(alloc)));
+			moved.min = moved.template duplicate_forest<true>(old.min,old._size,[](const internal_node *,np){});
+			moved._size = old._size;
+			moved.root_limit = old.root_limit;
+			moved.new_roots = old.new_roots;
+			old.clear();
+			swap_forest(moved,std::false_type());
+		} else {
+			fibonacci_heap moved(std::move(old));
+			swap_forest(moved,propagate);
+		}
 		return *this;
 	}
 
@@ -304,33 +1035,68 @@ public:
 	 * and will keep valid throughout the whole lifetime of the Fibonacci heap.
 	 * If the original Fibonacci heap is copied to a new heap, node objects of
 	 * the original Fibonacci heap will not work on the new heap.
+	 *
+	 * A node object keeps the key and data of its element alive even after the
+	 * element is removed from the heap or the heap is destroyed. Node objects
+	 * referring to the same element share a non-atomic reference count, so they
+	 * must not be copied or destroyed concurrently from different threads.
+	 *
+	 * The allocator is kept as a private base class, so that a node object can
+	 * free its element after the Fibonacci heap is gone, without taking extra
+	 * space for stateless allocators.
 	 */
-	class node {
+	class node : private node_allocator {
 
 		friend class fibonacci_heap;
 
 		/** \brief pointer to interanl node */
-		dsp internal;
+		np internal = nullptr;
 
 		/** \brief create a node object from internal nodes
 		 *
 		 * This is a private constructor, so the users are not allowed to create a node object.
+		 * @param alloc the allocator used to free the internal node
 		 * @param internal pointer to internal node
 		 */
-		node(ssp internal):internal(internal->data){}
+		node(const node_allocator &alloc,np internal):node_allocator(alloc),internal(internal) { acquire(); }
 
-		/** \brief create a node object from internal nodes
-		 *
-		 * This is a private constructor, so the users are not allowed to create a node object.
-		 * @param internal pointer to internal node
-		 */
-		node(dsp internal):internal(internal){}
+		void acquire() { if(internal) internal->handles++; }
+
+		void release() {
+			if(internal && --internal->handles==0 && !internal->in_heap)
+				destroy_node(*this,internal);
+			internal = nullptr;
+		}
+
+		/** \brief take the element of old together with its allocator */
+		void assign(node &&old,std::true_type) {
+			using std::swap;
+			swap(static_cast<node_allocator &>(*this),static_cast<node_allocator &>(old));
+			std::swap(internal,old.internal);
+		}
+
+		/** \brief the same, for allocators that can not be assigned, like std::pmr::polymorphic_allocator */
+		void assign(node &&old,std::false_type) {
+			this->~node();
+			::new(static_cast<void *>(this)) node(std::move(old));
+		}
 
 	public:
 
 		/** \brief this will create an empty node that don't belong to any Fibonacci heap */
 		node() = default;
 
+		node(const node &old):node_allocator(old),internal(old.internal) { acquire(); }
+
+		node(node &&old):node_allocator(old),internal(old.internal) { old.internal = nullptr; }
+
+		~node() { release(); }
+
+		node &operator=(node old) {
+			assign(std::move(old),std::is_move_assignable<node_allocator>());
+			return *this;
+		}
+
 		/** \brief get the key of this node.
 		 * @return the key of this node
 		 */
@@ -353,27 +1119,119 @@ public:
 
 	};
 
-	/** \brief Return the number of elements stored.
+	/** \brief Return the operation counters.
 	 *
-	 * @return number of elements stored in this Fibonacci heap
+	 * The counters are kept by the Stats policy, so with the default
+	 * fibonacci_no_stats, nothing is counted and an empty object is returned.
+	 * Counters cover the operations done on this object since it was created,
+	 * moved into, or reset_counters() was called; a copy of a Fibonacci heap
+	 * starts with fresh counters.
+	 *
+	 * @return the counters, which can be copied as a snapshot
 	 */
-	size_t size() const { return _size; }
+	const Stats &counters() const { return *this; }
 
-	/** \brief Insert an element.
+	/** \brief Reset the operation counters. */
+	void reset_counters() { static_cast<Stats &>(*this) = Stats(); }
+
+	/** \brief Return a copy of the allocator.
 	 *
-	 * @param key the key of the element to be inserted
-	 * @param data the data of the element to be inserted
-	 * @return node object holding the inserted element
+	 * @return the allocator used to allocate nodes
 	 */
-	node insert(K key,const T &data) { return insert(std::make_shared<internal_data>(key, data)); }
+	Allocator get_allocator() const { return Allocator(alloc); }
 
-	/** \brief Insert an element.
+	/** \brief Bound the work done by a single remove().
+	 *
+	 * By default, roots are only linked by remove(), so after n insertions, the
+	 * next remove() walks a root list of n roots. With a limit set, the roots are
+	 * consolidated as soon as more than "limit" roots have been added since the
+	 * last consolidation, by whichever operation adds them. The root list then
+	 * never grows beyond about limit+log(n) roots, which bounds the time of every
+	 * remove() to O(limit+log(n)), at the cost of an insert() now and then
+	 * doing that work instead. A smaller limit gives a lower bound on remove()
+	 * and a lower throughput of insert().
+	 *
+	 * The limit is kept by copies of this Fibonacci heap.
+	 *
+	 * @param limit the number of roots that can be added without consolidation,
+	 * or 0 to never consolidate outside of remove(), which is the default
+	 */
+	void set_consolidation_limit(size_t limit) {
+		root_limit = limit;
+		limit_roots();
+	}
+
+	/** \brief Return the limit set by set_consolidation_limit(). */
+	size_t consolidation_limit() const { return root_limit; }
+
+	/** \brief Return the number of elements stored.
+	 *
+	 * @return number of elements stored in this Fibonacci heap
+	 */
+	size_t size() const { return _size; }
+
+	/** \brief Statistics about the shape of the forest, returned by stats() */
+	struct shape {
+		size_t size = 0; ///< number of elements
+		size_t roots = 0; ///< length of the root list
+		std::vector<size_t> degrees; ///< degrees[d] is the number of nodes with d children
+		size_t degree_bound = 0; ///< the theoretical upper bound of degrees for this size
+		size_t height = 0; ///< number of nodes on the longest path from a root to a leaf
+		size_t marked = 0; ///< number of nodes that have lost a child since they became a child
+		size_t bytes = 0; ///< bytes used by the nodes in the heap and by this object
+	};
+
+	/** \brief Collect statistics about the shape of the forest.
+	 *
+	 * The forest is walked once in preorder by walk(), which takes O(n) time and
+	 * constant stack space, and does not change anything, so it can be sampled
+	 * periodically. Only the histogram of degrees is allocated.
+	 *
+	 * The bytes count nodes still in the heap, this object and its scratch
+	 * space, but not the overhead of the allocator or the nodes that are only
+	 * kept alive by node objects.
+	 *
+	 * @return the statistics
+	 */
+	shape stats() const {
+		shape s;
+		s.size = _size;
+		s.degree_bound = _size?max_degree():0;
+		s.bytes = sizeof(*this)+_size*sizeof(internal_node)+trees.capacity()*sizeof(np);
+		walk(-1,-1,[&](np p,np,size_t depth) {
+			if(!p->parent) s.roots++;
+			if(p->childcut) s.marked++;
+			if(p->degree>=s.degrees.size()) s.degrees.resize(p->degree+1,0);
+			s.degrees[p->degree]++;
+			s.height = std::max(s.height,depth+1);
+		});
+		return s;
+	}
+
+	/** \brief Insert an element.
 	 *
 	 * @param key the key of the element to be inserted
 	 * @param data the data of the element to be inserted
 	 * @return node object holding the inserted element
 	 */
-	node insert(K key,T &&data)  { return insert(std::make_shared<internal_data>(key, data)); }
+	node insert(K key,const T &data) { return insert(create_node(std::move(key), data)); }
+
+	/** \brief Insert an element.
+	 *
+	 * @param key the key of the element to be inserted
+	 * @param data the data of the element to be inserted
+	 * @return node object holding the inserted element
+	 */
+	node insert(K key,T &&data)  { return insert(create_node(std::move(key), std::move(data))); }
+
+	/** \brief Insert an element whose data is constructed in place.
+	 *
+	 * @param key the key of the element to be inserted
+	 * @param args the arguments forwarded to the constructor of data
+	 * @return node object holding the inserted element
+	 */
+	template <typename... Args>
+	node emplace(K key,Args&&... args) { return insert(create_node(std::piecewise_construct, std::move(key), std::forward<Args>(args)...)); }
 
 	/** \brief Insert an element.
 	 *
@@ -386,12 +1244,62 @@ public:
 	 */
 	node insert(node n) { return insert(n.key(),n.data()); }
 
+	/** \brief Insert a range of elements in O(n) time.
+	 *
+	 * Elements of the range can be anything that std::get<0> and std::get<1> can
+	 * extract the key and data from, e.g. std::tuple<K,T> or std::pair<K,T>.
+	 * Keys and data are moved if the range yields rvalues, so use
+	 * std::make_move_iterator to move them out of a container.
+	 *
+	 * All the new nodes are linked into the root list in a single pass that also
+	 * finds their minimum. If the allocator supports reserve() (for example
+	 * fibonacci_arena_allocator) and the range is a forward range, nodes are
+	 * allocated from one contiguous block. If constructing any element throws,
+	 * no element is inserted.
+	 *
+	 * Node objects of inserted elements are not returned; use insert() for
+	 * elements that need to be tracked.
+	 *
+	 * @param first the beginning of the range
+	 * @param last the end of the range
+	 */
+	template <typename InputIt>
+	void insert_range(InputIt first,InputIt last) {
+		reserve_range(first,last,typename std::iterator_traits<InputIt>::iterator_category());
+		np head = nullptr;
+		size_t count = 0;
+		try {
+			for(;first!=last;++first) {
+				auto &&e = *first;
+				np p = create_node(std::get<0>(std::forward<decltype(e)>(e)),std::get<1>(std::forward<decltype(e)>(e)));
+				count++;
+				// link p after head, and keep head pointing to the minimum
+				if(head) {
+					p->right_sibling = head->right_sibling;
+					p->left_sibling = head;
+					head->right_sibling->left_sibling = p;
+					head->right_sibling = p;
+					if(compare(p->key,head->key))
+						head = p;
+				} else
+					head = p;
+			}
+		} catch(...) {
+			release_forest(head);
+			throw;
+		}
+		meld(min,head,false,false,true,false);
+		_size += count;
+		new_roots += count;
+		limit_roots();
+	}
+
 	/** \brief Return the top element.
 	 * @return the node object on the top
 	 */
 	node top() const {
 		if(_size==0) throw "this Fibonacci heap is empty";
-		return node(min);
+		return node(alloc,min);
 	}
 
 	/** \brief Meld another Fibonacci heap to this Fibonacci heap.
@@ -400,13 +1308,73 @@ public:
 	 * parameter "fh" will become empty. After meld, both the node objects of
 	 * this and the node objects of parameter "fh" will work on this.
 	 *
+	 * Both Fibonacci heaps must use equal allocators, because nodes of "fh"
+	 * will be freed by the allocator of this.
+	 *
 	 * @param fh the Fibonacci heap to be melded
 	 */
-	void meld(fibonacci_heap<K,T,Compare> &fh) {
+	void meld(fibonacci_heap &fh) {
+		if(!(alloc==fh.alloc)) throw "can not meld Fibonacci heaps with different allocators";
+		// the roots of fh are at most those added since its last consolidation,
+		// plus those left by it
+		if(fh.min) new_roots += fh.new_roots+fh.max_degree()+1;
 		meld(min,fh.min,false,false,true,false);
 		fh.min = nullptr;
 		_size += fh._size;
 		fh._size = 0;
+		fh.new_roots = 0;
+		limit_roots();
+	}
+
+	/** \brief Move whole trees of the root list to another Fibonacci heap.
+	 *
+	 * Trees other than the one of the top element are taken from the root list
+	 * and melded into "fh" one by one, until at least n elements are moved. When
+	 * the top element is the only root left, as after a removal consolidated the
+	 * forest into one tree, the subtrees of its children are moved in the same
+	 * way, so only the top element itself is never moved. No key is compared and
+	 * the moved trees are not changed, but the elements of a tree have to be
+	 * counted, so the time is linear in the number of elements moved. Node
+	 * objects stay valid and follow their elements.
+	 *
+	 * This is meant to hand a part of the work over to another heap, as done by
+	 * work stealing, so the split is not balanced by keys.
+	 *
+	 * @param fh the Fibonacci heap that receives the trees, must use an equal allocator
+	 * @param n the number of elements wanted
+	 * @return the number of elements moved
+	 */
+	size_t split(fibonacci_heap &fh,size_t n) {
+		if(!(alloc==fh.alloc)) throw "can not meld Fibonacci heaps with different allocators";
+		if(&fh==this) return 0;
+		size_t moved = 0;
+		while(min && moved<n) {
+			// a child of the top is cut off the tree of the top, and may be marked
+			bool root = (min->right_sibling!=min);
+			np p = root?min->right_sibling:min->child;
+			if(!p) break;
+			remove_tree(p);
+			size_t count = tree_size(p);
+			meld(fh.min,p,!root,false,true,!root);
+			fh.new_roots++;
+			moved += count;
+		}
+		_size -= moved;
+		fh._size += moved;
+		fh.limit_roots();
+		return moved;
+	}
+
+	/** \brief Remove all the elements.
+	 *
+	 * The forest is torn down iteratively in linear time. Node objects still
+	 * held by the user stay valid, but are no longer in this Fibonacci heap.
+	 */
+	void clear() {
+		release_forest(min);
+		min = nullptr;
+		_size = 0;
+		new_roots = 0;
 	}
 
 	/** \brief Descrease (or increase if you use greater as Compare) the key of the given node.
@@ -419,65 +1387,202 @@ public:
 	 * @param new_key the new key of the node
 	 */
 	void decrease_key(node n,K new_key) {
-		if(Compare()(n.key(),new_key)) throw "increase_key is not supported";
-		if(n.internal->structure.expired()) throw "the given node is not in this Fibonacci heap";
-		ssp ns = n.internal->structure.lock();
-		ssp p = ns->parent.lock();
-		n.internal->key = new_key;
-		if(p) {
-			if(Compare()(new_key,p->data->key)) {
-				remove_tree(ns);
-				meld(min,ns,true,false,true,false);
-				cascading_cut(p);
+		if(compare(n.key(),new_key)) throw "increase_key is not supported";
+		if(!n.internal->in_heap) throw "the given node is not in this Fibonacci heap";
+		decrease_node_key(n.internal,std::move(new_key));
+	}
+
+	/** \brief Change the key of the given node, in either direction.
+	 *
+	 * Unlike decrease_key(), a larger key is also accepted. In that case the
+	 * node is repositioned in place: its children are moved to the root list
+	 * and it is cut from its parent, so the node object stays valid and
+	 * nothing is freed or allocated.
+	 *
+	 * @param n the node object of the element whose key is changed
+	 * @param new_key the new key of the node
+	 */
+	void update_key(node n,K new_key) {
+		if(!n.internal->in_heap) throw "the given node is not in this Fibonacci heap";
+		if(compare(n.key(),new_key))
+			increase_node_key(n.internal,std::move(new_key));
+		else
+			decrease_node_key(n.internal,std::move(new_key));
+	}
+
+	/** \brief Decrease the keys of many nodes at once.
+	 *
+	 * This has the same effect as calling decrease_key() for every element of
+	 * the range in order, but subtrees cut from their parents (including those
+	 * of cascading cuts) are first collected in a temporary list, which is
+	 * melded into the root list once at the end, and the min pointer is also
+	 * updated once.
+	 *
+	 * If some element of the range would increase the key or refers to a node
+	 * not in this Fibonacci heap, the elements before it are applied and an
+	 * exception is thrown, leaving the heap consistent.
+	 *
+	 * @param first the beginning of a range of (node, new key) pairs, anything
+	 * std::get<0> and std::get<1> work with, e.g. std::pair<node,K>
+	 * @param last the end of the range
+	 */
+	template <typename InputIt>
+	void decrease_keys(InputIt first,InputIt last) {
+		np cut = nullptr;
+		np best = nullptr;
+		try {
+			for(;first!=last;++first) {
+				auto &&e = *first;
+				np ns = std::get<0>(e).internal;
+				const K &new_key = std::get<1>(e);
+				if(compare(ns->key,new_key)) throw "increase_key is not supported";
+				if(!ns->in_heap) throw "the given node is not in this Fibonacci heap";
+				np p = ns->parent;
+				ns->key = new_key;
+				if(p) {
+					if(compare(ns->key,p->key)) {
+						remove_tree(ns);
+						Stats::cut();
+						new_roots++;
+						meld(cut,ns,true,false,true,false);
+						cascading_cut(p,cut);
+					}
+				} else if(!best || compare(ns->key,best->key))
+					best = ns;
 			}
-		} else if(Compare()(new_key,min->data->key))
-			min = ns;
+		} catch(...) {
+			meld(min,cut,false,false,true,false);
+			if(best && compare(best->key,min->key)) min = best;
+			limit_roots();
+			throw;
+		}
+		meld(min,cut,false,false,true,false);
+		if(best && compare(best->key,min->key)) min = best;
+		limit_roots();
 	}
 
 	/** \brief Remove the top element.
 	 * @return the removed node object
 	 */
 	node remove() {
-		if(_size==0) throw "no element to remove";
-		ssp oldmin = min;
-		if(_size==1) {
-			_size = 0;
-			min = nullptr;
-			return node(oldmin);
-		}
-
-		// merge trees of same degrees
-		std::vector<ssp> trees(max_degree()+1);
-		if(min->child)
-			meld(min,min->child,false,false,false,false);
-		while(min->right_sibling!=min) {
-			ssp q = min->right_sibling;
-			remove_tree(q);
-			while(trees[q->degree]) {
-				bool q_is_smaller = Compare()(q->data->key,trees[q->degree]->data->key);
-				ssp smaller = q_is_smaller?q:trees[q->degree];
-				ssp larger = q_is_smaller?trees[q->degree]:q;
-				trees[q->degree] = nullptr;
-				meld(smaller->child,larger,true,false,false,true,smaller);
-				smaller->degree++;
-				q = smaller;
-			}
-			trees[q->degree] = q;
-		}
+		np oldmin = remove_min();
+		return node(alloc,oldmin);
+	}
 
-		// meld trees of different degree back
-		// cut the loop so that the resource for deleted structure node can be
-		// cleaned up by std::shared_ptr.
-		min->right_sibling = nullptr;
-		min = nullptr;
-		for(ssp p:trees) {
-			if(!p) continue;
-			meld(min,p,true,false,true,false);
-		}
+	/** \brief Remove the top element and move its key and data out.
+	 *
+	 * Unlike remove(), no node object is created, so this works with move-only
+	 * data and frees the element right away. If some node object still refers
+	 * to the removed element, it keeps the element alive but sees the moved-from
+	 * key and data.
+	 *
+	 * @return the key and data of the removed element
+	 */
+	std::tuple<K,T> pop() {
+		np oldmin = remove_min();
+		std::tuple<K,T> ret(std::move(oldmin->key),std::move(oldmin->data));
+		if(oldmin->handles==0) destroy_node(alloc,oldmin);
+		return ret;
+	}
 
-		_size--;
-		oldmin->data->structure.reset();
-		return node(oldmin->data);
+	/** \brief Remove the k top elements at once.
+	 *
+	 * This is equivalent to calling remove() k times, but the roots are only
+	 * consolidated when the root list grows too long, instead of after every
+	 * removed element. Removed elements are written in order of their keys.
+	 *
+	 * @param k maximum number of elements to remove, fewer are removed if the
+	 * heap runs out of elements
+	 * @param out output iterator that receives node objects of removed elements
+	 * @return the output iterator after the last written node object
+	 */
+	template <typename OutputIt>
+	OutputIt remove_top_k(size_t k,OutputIt out) {
+		return remove_batch([&](np){ return k-->0; },out);
+	}
+
+	/** \brief Remove top elements as long as their keys satisfy a predicate.
+	 *
+	 * Works the same way as remove_top_k(), stopping at the first top element
+	 * whose key does not satisfy the predicate, or when the heap becomes empty.
+	 *
+	 * @param pred unary predicate called with the key of the top element
+	 * @param out output iterator that receives node objects of removed elements
+	 * @return the output iterator after the last written node object
+	 */
+	template <typename Predicate,typename OutputIt>
+	OutputIt pop_while(Predicate pred,OutputIt out) {
+		return remove_batch([&](np p){ return pred(static_cast<const K &>(p->key)); },out);
+	}
+
+	/** \brief Remove all the elements whose keys are less than a bound.
+	 *
+	 * Because of the min-tree property, every element below the bound is in the
+	 * upper part of a tree whose root is below the bound, so only these parts are
+	 * visited: subtrees whose roots are not below the bound are cut off and become
+	 * new roots without being looked into. The roots are consolidated once at the
+	 * end, so the time is proportional to the number of removed elements plus the
+	 * length of the root list. No memory is allocated.
+	 *
+	 * @param bound elements with keys less than bound (in the order defined by
+	 * Compare) are removed
+	 * @param out output iterator that receives node objects of removed elements,
+	 * which are NOT written in order of their keys
+	 * @return the output iterator after the last written node object
+	 */
+	template <typename OutputIt>
+	OutputIt extract_below(const K &bound,OutputIt out) {
+		if(!min||!compare(min->key,bound)) return out;
+		// nodes to be removed are collected in a singly linked work list through
+		// right_sibling, remaining roots are collected in the sibling list "keep"
+		np work = nullptr;
+		np keep = nullptr;
+		np p = min;
+		np last = min->left_sibling;
+		for(;;) {
+			np next = p->right_sibling;
+			if(compare(p->key,bound)) {
+				remove_tree(p);
+				p->right_sibling = work;
+				work = p;
+			} else
+				keep = p;
+			if(p==last) break;
+			p = next;
+		}
+		while(work) {
+			np x = work;
+			work = x->right_sibling;
+			if(x->child) {
+				np c = x->child;
+				np clast = c->left_sibling;
+				for(;;) {
+					np next = c->right_sibling;
+					c->parent = nullptr;
+					if(compare(c->key,bound)) {
+						c->right_sibling = work;
+						work = c;
+					} else {
+						c->childcut = false;
+						c->right_sibling = c;
+						c->left_sibling = c;
+						meld(keep,c,false,false,false,false);
+					}
+					if(c==clast) break;
+					c = next;
+				}
+			}
+			x->right_sibling = x;
+			x->left_sibling = x;
+			x->child = nullptr;
+			x->degree = 0;
+			x->in_heap = false;
+			_size--;
+			*out++ = node(alloc,x);
+		}
+		min = keep;
+		if(min) consolidate();
+		return out;
 	}
 
 	/** \brief Remove the element specified by the node object.
@@ -490,24 +1595,439 @@ public:
 	 * @return the removed node object
 	 */
 	node remove(node n) {
-		if(n.internal->structure.expired()) throw "the given node is not in this Fibonacci heap";
-		ssp p = n.internal->structure.lock();
-		if(p==min) return remove();
-		_size--;
-		// remove n from tree
-		remove_tree(p);
-		p->data->structure.reset();
-		// insert n's child back
-		if(p->child) meld(min,p->child,true,true,true,false);
-		// cascading cut
-		cascading_cut(p->parent.lock());
-		// cut the loop so that the resource for deleted structure node can be
-		// cleaned up by std::shared_ptr.
-		p->child = nullptr;
-		p->right_sibling = nullptr;
+		if(!n.internal->in_heap) throw "the given node is not in this Fibonacci heap";
+		remove_node(n.internal);
 		return n;
 	}
 
+	/** \brief A cheap fork of a Fibonacci heap for speculative changes.
+	 *
+	 * Because nodes have parent pointers and sibling lists are doubly linked,
+	 * two heaps can not share a subtree while one of them changes it, so a
+	 * snapshot never touches the forest of the heap it is taken from (the base).
+	 * Instead it keeps the changes made to it on the side:
+	 *
+	 * - elements inserted into the snapshot, and base elements whose key was
+	 *   changed in the snapshot, live in a small Fibonacci heap of its own;
+	 * - base elements removed or re-keyed in the snapshot are hidden;
+	 * - base elements are visited in the order of their keys by a binary heap
+	 *   of candidates. Initially the candidates are the base roots. Taking a
+	 *   base element out adds its children as candidates.
+	 *
+	 * Taking a snapshot is O(1), and the memory it uses grows with the number
+	 * of operations done on it, not with the size of the base. The first call
+	 * that needs the top element costs O(number of base roots), which is
+	 * O(log n) if the base has been consolidated by a removal since its last
+	 * insertion.
+	 *
+	 * The base must not be modified or destroyed while the snapshot is in use.
+	 * Node objects of the base can be used with the snapshot to refer to the
+	 * same elements, and the node objects returned by top() and remove() may
+	 * belong to either the base or the snapshot. Elements of the base are not
+	 * copied unless their keys are changed, so their data is shared with the
+	 * base. Popping a base element copies its key and data.
+	 *
+	 * Node objects of base elements returned by top() and remove() count as
+	 * references in the base nodes, and these counts are not atomic. So even
+	 * though the base is not modified, snapshots of the same base must not be
+	 * used from different threads at the same time, nor while node objects of
+	 * the base are copied or destroyed in another thread.
+	 */
+	class overlay {
+
+		friend class fibonacci_heap;
+
+		typedef const internal_node *cnp;
+
+		/** \brief the heap this snapshot is taken from */
+		const fibonacci_heap *base;
+
+		/** \brief elements inserted or re-keyed in this snapshot */
+		fibonacci_heap local;
+
+		/** \brief nodes of local, to tell them from nodes of the base, and the
+		 * base nodes they are copies of (nullptr for inserted elements) */
+		std::unordered_map<cnp,cnp> local_nodes;
+
+		/** \brief base nodes that are removed or re-keyed in this snapshot */
+		std::unordered_set<cnp> hidden;
+
+		/** \brief base nodes re-keyed in this snapshot, and their copies in local */
+		std::unordered_map<cnp,node> moved;
+
+		/** \brief binary heap of base nodes whose ancestors are all taken out */
+		std::vector<cnp> candidates;
+
+		bool started = false;
+
+		size_t _size;
+
+		overlay(const fibonacci_heap &base):base(&base),local(Allocator(node_alloc_traits::select_on_container_copy_construction(base.alloc))),_size(base._size) {}
+
+		static bool candidate_greater(cnp a,cnp b) { return Compare()(b->key,a->key); }
+
+		void add_candidates(cnp list) {
+			if(!list) return;
+			cnp p = list;
+			do {
+				candidates.push_back(p);
+				std::push_heap(candidates.begin(),candidates.end(),candidate_greater);
+				p = p->right_sibling;
+			} while(p!=list);
+		}
+
+		/** \brief take the top candidate out and replace it by its children */
+		void pop_candidate() {
+			cnp p = candidates.front();
+			std::pop_heap(candidates.begin(),candidates.end(),candidate_greater);
+			candidates.pop_back();
+			add_candidates(p->child);
+		}
+
+		/** \brief return the minimum base node that is not hidden, or nullptr */
+		cnp base_top() {
+			if(!started) {
+				add_candidates(base->min);
+				started = true;
+			}
+			while(!candidates.empty() && hidden.count(candidates.front()))
+				pop_candidate();
+			return candidates.empty()?nullptr:candidates.front();
+		}
+
+		/** \brief whether the top element is in local rather than in the base */
+		bool top_is_local() {
+			if(_size==0) throw "no element to remove";
+			cnp b = base_top();
+			return !b || (local.min && !Compare()(b->key,local.min->key));
+		}
+
+		node own(node n,cnp origin = nullptr) {
+			local_nodes.emplace(n.internal,origin);
+			return n;
+		}
+
+		/** \brief forget a node of local that is taken out, and the base node it is a copy of */
+		void disown(cnp p) {
+			auto it = local_nodes.find(p);
+			if(it->second)
+				moved.erase(it->second);
+			local_nodes.erase(it);
+		}
+
+	public:
+
+		/** \brief A snapshot can be moved but not copied, its bookkeeping refers to the nodes of its own local heap. */
+		overlay(const overlay &) = delete;
+		overlay &operator=(const overlay &) = delete;
+		overlay(overlay &&) = default;
+		overlay &operator=(overlay &&) = default;
+
+		/** \brief Return the number of elements in this snapshot. */
+		size_t size() const { return _size; }
+
+		/** \brief Insert an element into this snapshot only. */
+		node insert(K key,const T &data) { _size++; return own(local.insert(std::move(key),data)); }
+
+		/** \brief Insert an element into this snapshot only. */
+		node insert(K key,T &&data) { _size++; return own(local.insert(std::move(key),std::move(data))); }
+
+		/** \brief Insert an element whose data is constructed in place into this snapshot only. */
+		template <typename... Args>
+		node emplace(K key,Args&&... args) { _size++; return own(local.emplace(std::move(key),std::forward<Args>(args)...)); }
+
+		/** \brief Return the top element.
+		 * @return the node object on the top, which may belong to the base
+		 */
+		node top() {
+			if(top_is_local()) return local.top();
+			return node(base->alloc,const_cast<np>(base_top()));
+		}
+
+		/** \brief Remove the top element.
+		 * @return the removed node object, which may belong to the base
+		 */
+		node remove() {
+			node n = top();
+			remove(n);
+			return n;
+		}
+
+		/** \brief Remove the top element and return its key and data. */
+		std::tuple<K,T> pop() {
+			if(top_is_local()) {
+				disown(local.min);
+				_size--;
+				return local.pop();
+			}
+			cnp b = base_top();
+			pop_candidate();
+			hidden.insert(b);
+			_size--;
+			return std::tuple<K,T>(b->key,b->data);
+		}
+
+		/** \brief Change the key of an element in this snapshot, in either direction.
+		 *
+		 * The first time the key of a base element is changed, its key and data are
+		 * copied into the snapshot, and the base element is hidden. The node object
+		 * of the base keeps referring to the element in later calls, but its key()
+		 * is still the key in the base; the key in the snapshot is seen through the
+		 * node object returned by top().
+		 *
+		 * @param n node object of the base or of this snapshot
+		 * @param new_key the new key
+		 */
+		void update_key(node n,K new_key) {
+			cnp p = n.internal;
+			if(local_nodes.count(p)) {
+				local.update_key(n,std::move(new_key));
+				return;
+			}
+			auto it = moved.find(p);
+			if(it!=moved.end()) {
+				local.update_key(it->second,std::move(new_key));
+				return;
+			}
+			if(!p->in_heap || hidden.count(p)) throw "the given node is not in this Fibonacci heap";
+			node copy = own(local.insert(std::move(new_key),p->data),p);
+			hidden.insert(p);
+			moved.emplace(p,std::move(copy));
+		}
+
+		/** \brief Decrease the key of an element in this snapshot.
+		 * @param n node object of the base or of this snapshot
+		 * @param new_key the new key
+		 */
+		void decrease_key(node n,K new_key) {
+			auto it = moved.find(n.internal);
+			const K &key = (it==moved.end())?n.key():it->second.key();
+			if(Compare()(key,new_key)) throw "increase_key is not supported";
+			update_key(std::move(n),std::move(new_key));
+		}
+
+		/** \brief Remove an element from this snapshot.
+		 * @param n node object of the base or of this snapshot
+		 * @return the removed node object
+		 */
+		node remove(node n) {
+			cnp p = n.internal;
+			if(local_nodes.count(p)) {
+				local.remove(n);
+				disown(p);
+			} else {
+				auto it = moved.find(p);
+				if(it!=moved.end()) {
+					node copy = std::move(it->second);
+					disown(copy.internal);
+					local.remove(copy);
+				} else if(!p->in_heap || !hidden.insert(p).second)
+					throw "the given node is not in this Fibonacci heap";
+			}
+			_size--;
+			return n;
+		}
+
+	};
+
+	/** \brief Take a snapshot of this Fibonacci heap in O(1) time.
+	 *
+	 * See overlay for what can be done with it. This Fibonacci heap must not be
+	 * modified or destroyed while the snapshot is in use.
+	 *
+	 * @return the snapshot
+	 */
+	overlay snapshot() const { return overlay(*this); }
+
+	/** \brief Write a binary image of this Fibonacci heap to a stream.
+	 *
+	 * Only available if K and T are trivially copyable. The image holds the
+	 * key, data, degree and childcut mark of every node in preorder, starting
+	 * from the min root, so load() rebuilds exactly the same forest, including
+	 * the order of siblings. Keys and data are written as raw bytes in native
+	 * byte order, so an image can only be loaded on the same kind of platform
+	 * by a program using the same K and T.
+	 *
+	 * @param os the stream to write to, which should be opened in binary mode
+	 */
+	void save(std::ostream &os) const {
+		static_assert(std::is_trivially_copyable<K>::value&&std::is_trivially_copyable<T>::value,"save() requires trivially copyable keys and data");
+		image_header h;
+		h.size = _size;
+		os.write(reinterpret_cast<const char *>(&h),sizeof(h));
+		std::vector<char> buf;
+		buf.reserve(image_buffer_size);
+		walk(-1,-1,[&](np p,np,size_t) {
+			size_t pos = buf.size();
+			buf.resize(pos+image_record_size);
+			std::memcpy(&buf[pos],&p->key,sizeof(K));
+			std::memcpy(&buf[pos+sizeof(K)],&p->data,sizeof(T));
+			buf[pos+sizeof(K)+sizeof(T)] = static_cast<char>(p->degree);
+			buf[pos+sizeof(K)+sizeof(T)+1] = p->childcut;
+			if(buf.size()+image_record_size>image_buffer_size) {
+				os.write(buf.data(),buf.size());
+				buf.clear();
+			}
+		});
+		os.write(buf.data(),buf.size());
+		if(!os) throw "can not write the Fibonacci heap image";
+	}
+
+	/** \brief Replace the contents of this Fibonacci heap by an image written by save().
+	 *
+	 * The image is read in large chunks, and the allocator is asked to reserve
+	 * all the nodes up front if it supports reserve(), so that with
+	 * fibonacci_arena_allocator, all the nodes come from one bulk allocation.
+	 * The forest is rebuilt in the same pass, using a stack of the nodes whose
+	 * children are still being read, so that restoring costs about as much as
+	 * reading the stream. The image is checked for the min-tree property and for
+	 * the degrees matching the number of nodes; if it is broken, an exception is
+	 * thrown and this Fibonacci heap is not changed.
+	 *
+	 * Node objects of the old contents are no longer in this Fibonacci heap
+	 * after loading, just like after clear().
+	 *
+	 * @param is the stream to read from, which should be opened in binary mode
+	 */
+	void load(std::istream &is) {
+		static_assert(std::is_trivially_copyable<K>::value&&std::is_trivially_copyable<T>::value,"load() requires trivially copyable keys and data");
+		image_header h, expected;
+		is.read(reinterpret_cast<char *>(&h),sizeof(h));
+		if(!is) throw "can not read the Fibonacci heap image";
+		if(std::memcmp(h.magic,expected.magic,sizeof(h.magic))!=0||h.byte_order!=expected.byte_order
+		   ||h.key_size!=expected.key_size||h.data_size!=expected.data_size)
+			throw "the Fibonacci heap image is not compatible";
+		reserve_nodes(alloc,h.size,0);
+		np roots = nullptr;
+		size_t nroots = 0;
+		// nodes whose children are being read, with the number of children left
+		std::vector<std::pair<np,size_t>> parents;
+		std::vector<char> buf;
+		size_t pos = 0;
+		try {
+			for(uint64_t i=0;i<h.size;i++) {
+				if(pos==buf.size()) {
+					buf.resize(std::min<uint64_t>(image_buffer_size/image_record_size,h.size-i)*image_record_size);
+					is.read(buf.data(),buf.size());
+					if(!is) throw "can not read the Fibonacci heap image";
+					pos = 0;
+				}
+				typename std::aligned_storage<sizeof(K),alignof(K)>::type key;
+				typename std::aligned_storage<sizeof(T),alignof(T)>::type data;
+				std::memcpy(&key,&buf[pos],sizeof(K));
+				std::memcpy(&data,&buf[pos+sizeof(K)],sizeof(T));
+				size_t degree = static_cast<unsigned char>(buf[pos+sizeof(K)+sizeof(T)]);
+				bool childcut = buf[pos+sizeof(K)+sizeof(T)+1];
+				pos += image_record_size;
+				np q = create_node(*reinterpret_cast<K *>(&key),*reinterpret_cast<T *>(&data));
+				q->degree = degree;
+				q->childcut = childcut;
+				if(parents.empty())
+					nroots++;
+				else {
+					q->parent = parents.back().first;
+					parents.back().second--;
+				}
+				// the first root must be the min, and children must not be less than their parents
+				np above = q->parent?q->parent:roots;
+				if(above && compare(q->key,above->key)) {
+					destroy_node(alloc,q);
+					throw "the Fibonacci heap image is broken";
+				}
+				// append q to its sibling list to keep the order of siblings
+				np &head = q->parent?q->parent->child:roots;
+				if(head) {
+					q->left_sibling = head->left_sibling;
+					q->right_sibling = head;
+					head->left_sibling->right_sibling = q;
+					head->left_sibling = q;
+				} else
+					head = q;
+				if(degree)
+					parents.emplace_back(q,degree);
+				else
+					while(!parents.empty()&&parents.back().second==0)
+						parents.pop_back();
+			}
+			if(!parents.empty()) throw "the Fibonacci heap image is broken";
+		} catch(...) {
+			release_forest(roots);
+			throw;
+		}
+		release_forest(min);
+		min = roots;
+		_size = h.size;
+		new_roots = nroots;
+		limit_roots();
+	}
+
+	/** \brief write the graph in dot format to a stream, which can be used for illustration
+	 *
+	 * Nodes at the same depth are put at the same rank, by chaining each node to
+	 * the last one written at its depth. Output is streamed in one pass over the
+	 * forest, following child, right_sibling and parent pointers in preorder, so
+	 * it takes O(n) time, and O(h) memory for a forest of height h besides the
+	 * formatted strings of one node.
+	 *
+	 * To keep dumps of large heaps usable, only the nodes that come first in
+	 * preorder, and the nodes close to the roots, can be written. Pointers are
+	 * only written if both their ends are written.
+	 *
+	 * @param os the stream to write to
+	 *
+	 * @param max_nodes the maximum number of nodes to write, default no limit
+	 *
+	 * @param max_depth the maximum depth of nodes to write, where roots have depth
+	 * 1, default no limit
+	 *
+	 * @param node_format, child_format, parent_format, right_sibling_format,
+	 * left_sibling_format, double_arrow_format the same as those of dot()
+	 */
+	void write_dot(std::ostream &os,size_t max_nodes = -1,size_t max_depth = -1,
+					std::string node_format(void *address,const K &key,const T &data) = [](void *,const K &key,const T &){ return "label="+std::to_string(key); },
+					const std::string &child_format = "color=black",
+					const std::string &parent_format = "color=green",
+					const std::string &right_sibling_format = "color=red",
+					const std::string &left_sibling_format = "color=blue",
+					const std::string &double_arrow_format = "dir=both color=\"red:blue\""
+				   ) const {
+		os << "digraph{min->addr" << min << "[" << child_format << "];";
+		if(!min||!max_nodes||!max_depth) {
+			os << "addr" << min << "[style=invis];}";
+			return;
+		}
+		auto arrow = [&](np from,np to,const std::string &format) {
+			os << "addr" << from << "->addr" << to << "[" << format << "];";
+		};
+		// the last node written at each depth
+		std::vector<np> last;
+		// output each node, then the pointers between it and the nodes before it in preorder
+		walk(max_nodes,max_depth,[&](np p,np prev,size_t depth) {
+			os << "addr" << p << "[" << node_format(p,p->key,p->data) << "];";
+			if(depth<last.size()) {
+				os << "{rank=same;addr" << last[depth] << ";addr" << p << "};";
+				last[depth] = p;
+			} else
+				last.push_back(p);
+			np head = p->parent?p->parent->child:min;
+			if(p==p->right_sibling&&p==p->left_sibling)
+				arrow(p,p,double_arrow_format);
+			else {
+				if(prev)
+					arrow(prev,p,(p->left_sibling==prev)?double_arrow_format:right_sibling_format);
+				if(p->right_sibling==head&&p!=head)
+					arrow(p,head,(head->left_sibling==p)?double_arrow_format:right_sibling_format);
+				if(p->left_sibling->right_sibling!=p)
+					arrow(p,p->left_sibling,left_sibling_format);
+			}
+			if(p->parent) {
+				if(!prev) arrow(p->parent,p,child_format);
+				arrow(p,p->parent,parent_format);
+			}
+		});
+		os << "}";
+	}
+
 	/** \brief generate the graph in dot format which can be used for illustration
 	 *
 	 * @param node_format a function that given the pointer address, key and data
@@ -544,81 +2064,639 @@ public:
 					std::string left_sibling_format = "color=blue",
 					std::string double_arrow_format = "dir=both color=\"red:blue\""
 				   ) const {
-		using nodes_t = std::map<int,std::vector<std::string>>;
-		std::function<std::tuple<nodes_t,std::string>(int,ssp,ssp)> traverse = [&](int depth,ssp start,ssp end)->std::tuple<nodes_t,std::string> {
-			if(!start) return std::make_tuple(nodes_t(),"");
-			if(start==end) return std::make_tuple(nodes_t(),"");
-			bool head_of_sibling_list = !end;
-			if(head_of_sibling_list) end = start;
-
-			nodes_t nodes;
-			std::ostringstream oss_arrows;
-
-			// insert this node to node map
-			std::ostringstream oss_nodes;
-			oss_nodes << "addr" << start;
-			if(start->data)
-				oss_nodes << "[" << node_format(start.get(),start->data->key,start->data->data) << "];";
-			nodes[depth] = { oss_nodes.str() };
-
-			// print pointers of start node
-			if(start==start->right_sibling&&start==start->left_sibling.lock()) {
-				oss_arrows << "addr" << start << "->addr" << start << "[" << double_arrow_format << "];";
-			} else {
-				if(start->right_sibling) {
-					if(start->right_sibling->left_sibling.lock()==start)
-						oss_arrows << "addr" << start << "->addr" << start->right_sibling << "[" << double_arrow_format << "];";
-					else
-						oss_arrows << "addr" << start << "->addr" << start->right_sibling << "[" << right_sibling_format << "];";
-				}
-				if(!start->left_sibling.expired()&&start->left_sibling.lock()->right_sibling!=start)
-					oss_arrows << "addr" << start << "->addr" << start->left_sibling.lock() << "[" << left_sibling_format << "];";
-			}
-			if(start->child)
-				oss_arrows << "addr" << start << "->addr" << start->child << "[" << child_format << "];";
-			if(!start->parent.expired())
-				oss_arrows << "addr" << start << "->addr" << start->parent.lock() << "[" << parent_format << "];";
-
-			// collect and combine results from other elements in sibling lilst and children
-			std::function<void(nodes_t &)> merge_nodes = [&](nodes_t &a){
-				for(auto i=a.begin();i!=a.end();++i){
-					int depth = i->first;
-					std::vector<std::string> v = i->second;
-					if(nodes.count(depth)>0)
-						nodes[depth].insert(nodes[depth].end(),v.begin(),v.end());
-					else
-						nodes[depth] = v;
-				}
-			};
-			std::tuple<nodes_t,std::string> sibling_output = traverse(depth,start->right_sibling,end);
-			merge_nodes(std::get<0>(sibling_output));
-			oss_arrows << std::get<1>(sibling_output);
-			std::tuple<nodes_t,std::string> child_output = traverse(depth+1,start->child,nullptr);
-			merge_nodes(std::get<0>(child_output));
-			oss_arrows << std::get<1>(child_output);
-			return std::make_tuple(nodes,oss_arrows.str());
-		};
 		std::ostringstream oss;
-		oss << "digraph{min->addr" << min << "[" << child_format << "];";
-		if(!min)
-			oss << "addr0[style=invis];}";
-		else {
-			std::tuple<nodes_t,std::string> traverse_output = traverse(0,min,nullptr);
-			nodes_t nodes = std::get<0>(traverse_output);
-			// output nodes
-			int i = 0;
-			while(nodes.count(i)>0){
-				oss << "{rank=same;";
-				for(std::string &n:nodes[i])
-					oss << n;
-				oss << "};";
-				i++;
+		write_dot(oss,-1,-1,node_format,child_format,parent_format,right_sibling_format,left_sibling_format,double_arrow_format);
+		return oss.str();
+	}
+};
+
+/** \brief A Fibonacci heap of elements identified by dense integer ids
+ *
+ * This is designed for graph algorithms like Dijkstra's and Prim's algorithm,
+ * where elements are vertices 0..capacity-1. Nodes of all the ids are allocated
+ * once in a flat array when the heap is created, so no operation allocates
+ * memory, and the node of an id is found in O(1) time. The structure and all
+ * the algorithms are the same as fibonacci_heap.
+ *
+ * @param K the type for keys, must be default constructible
+ * @param Compare the class that define the order of keys, with default value the "<".
+ */
+template <typename K, typename Compare=std::less<K>>
+class indexed_fibonacci_heap {
+
+	/** \brief data of elements, the id is the position of the node in the array */
+	struct empty {};
+
+	using heap_t = fibonacci_heap<K,empty,Compare>;
+	using internal_node = typename heap_t::internal_node;
+
+	std::vector<internal_node> slots;
+	heap_t heap;
+
+public:
+
+	/** \brief Create an empty heap for ids 0..capacity-1.
+	 * @param capacity number of ids
+	 */
+	explicit indexed_fibonacci_heap(size_t capacity):slots(capacity,internal_node(K(),empty())) {
+		for(internal_node &n:slots)
+			n.in_heap = false;
+		// make the consolidation scratch large enough for any degree, that is,
+		// more than log(capacity)/log(golden ratio)
+		size_t max_degree = 1;
+		for(size_t c=capacity;c;c>>=1)
+			max_degree += 2;
+		heap.trees.resize(max_degree,nullptr);
+	}
+
+	indexed_fibonacci_heap(const indexed_fibonacci_heap &) = delete;
+	indexed_fibonacci_heap(indexed_fibonacci_heap &&) = default;
+	indexed_fibonacci_heap &operator=(const indexed_fibonacci_heap &) = delete;
+
+	~indexed_fibonacci_heap() {
+		// nodes belong to slots, don't let the heap free them
+		heap.min = nullptr;
+		heap._size = 0;
+	}
+
+	/** \brief Return the number of ids this heap can hold. */
+	size_t capacity() const { return slots.size(); }
+
+	/** \brief Return the number of elements stored. */
+	size_t size() const { return heap.size(); }
+
+	/** \brief Test whether an id is in this heap.
+	 * @param id the id to test
+	 * @return true if id is in this heap
+	 */
+	bool contains(size_t id) const { return slots[id].in_heap; }
+
+	/** \brief Return the key of an id.
+	 *
+	 * If the id is no longer in this heap, the key it had when it was removed is returned.
+	 *
+	 * @param id the id
+	 * @return the key of id
+	 */
+	const K &key(size_t id) const { return slots[id].key; }
+
+	/** \brief Insert an id.
+	 * @param id the id to be inserted, must not be in this heap
+	 * @param key the key of the id
+	 */
+	void push(size_t id,K key) {
+		internal_node &n = slots[id];
+		if(n.in_heap) throw "the given id is already in this Fibonacci heap";
+		n.key = std::move(key);
+		n.childcut = false;
+		n.in_heap = true;
+		n.degree = 0;
+		n.right_sibling = &n;
+		n.left_sibling = &n;
+		n.child = nullptr;
+		n.parent = nullptr;
+		heap.link_node(&n);
+	}
+
+	/** \brief Descrease the key of an id.
+	 * @param id the id, must be in this heap
+	 * @param key the new key, must not be larger than the current key
+	 */
+	void decrease_key(size_t id,K key) {
+		if(Compare()(slots[id].key,key)) throw "increase_key is not supported";
+		if(!slots[id].in_heap) throw "the given id is not in this Fibonacci heap";
+		heap.decrease_node_key(&slots[id],std::move(key));
+	}
+
+	/** \brief Return the id of the top element. */
+	size_t top() const {
+		if(heap.size()==0) throw "this Fibonacci heap is empty";
+		return heap.min-slots.data();
+	}
+
+	/** \brief Remove the top element.
+	 * @return the id of the removed element
+	 */
+	size_t pop() {
+		return heap.remove_min()-slots.data();
+	}
+
+	/** \brief Remove an id.
+	 * @param id the id to be removed, must be in this heap
+	 */
+	void remove(size_t id) {
+		if(!slots[id].in_heap) throw "the given id is not in this Fibonacci heap";
+		heap.remove_node(&slots[id]);
+	}
+};
+
+/** \brief A node of basic_compact_fibonacci_heap
+ *
+ * Nodes live in one contiguous pool and refer to each other by their positions
+ * in it, so a pool can be moved around in memory, or stored in a file, without
+ * fixing any link. The degree and the childcut mark are packed into one byte.
+ *
+ * @param K the type for keys
+ * @param T the type for data
+ * @param Index the unsigned integer type for positions of nodes in the pool
+ */
+template <typename K, typename T, typename Index>
+struct fibonacci_compact_node {
+	using index_type = Index;
+
+	/** \brief a position that refers to no node */
+	static constexpr Index nil = Index(-1);
+
+	/** \brief mask of the childcut bit in bits, the lower bits store the degree */
+	static constexpr uint8_t childcut_bit = 0x80;
+
+	K key;
+	T data;
+	Index parent;
+	Index child;
+	/** \brief the left sibling, nil if this node is not in the heap */
+	Index left;
+	/** \brief the right sibling, or the next free node if this node is not in the heap */
+	Index right;
+	uint8_t bits;
+
+	size_t degree() const { return bits&~childcut_bit; }
+	bool childcut() const { return bits&childcut_bit; }
+};
+
+// definitions of the constants, for their odr-uses before C++17
+template <typename K, typename T, typename Index>
+constexpr Index fibonacci_compact_node<K,T,Index>::nil;
+
+template <typename K, typename T, typename Index>
+constexpr uint8_t fibonacci_compact_node<K,T,Index>::childcut_bit;
+
+/** \brief The state of basic_compact_fibonacci_heap besides its nodes
+ *
+ * It is kept by the pool, next to the nodes, so that a pool stored in a file
+ * holds the whole heap.
+ */
+template <typename Index>
+struct fibonacci_compact_meta {
+	/** \brief the top node */
+	Index min = Index(-1);
+	/** \brief the head of the list of free nodes */
+	Index free = Index(-1);
+	/** \brief number of elements in the heap */
+	uint64_t size = 0;
+	/** \brief number of nodes of the pool ever used, free or not */
+	uint64_t used = 0;
+};
+
+/** \brief A Fibonacci heap whose nodes are stored in a pool and linked by indices
+ *
+ * The algorithms are the same as fibonacci_heap, but instead of nodes allocated
+ * one by one and linked by pointers, all the nodes are elements of a single
+ * array owned by Pool, and an element is identified by the index of its node.
+ * Indices of removed elements are reused by later insertions.
+ *
+ * Only the basic operations of fibonacci_heap are provided: insert, top, pop,
+ * decrease_key, update_key, remove, and access to keys and data. There is no
+ * consolidation limit, no Stats hooks, no meld, split or batch removal, and no
+ * copy, dot output or image; use fibonacci_heap when these are needed.
+ *
+ * Pool<fibonacci_compact_node<K,T,Index>> must provide:
+ * - `fibonacci_compact_meta<Index> &meta()` and its const version;
+ * - `node_type *nodes()` and its const version, the array of nodes;
+ * - `size_t capacity() const`, the length of the array;
+ * - `void reserve(size_t n)`, which makes the array at least n long, keeping its content;
+ * - `bool writable() const`, false if the heap must not be modified.
+ *
+ * The arguments of the constructor are forwarded to the constructor of the pool.
+ *
+ * @param K the type for keys
+ * @param T the type for data
+ * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Index the unsigned integer type for indices, which limits the number of nodes
+ * @param Pool the storage of nodes
+ */
+template <typename K, typename T, typename Compare, typename Index, template <typename> class Pool>
+class basic_compact_fibonacci_heap {
+
+	static_assert(std::is_unsigned<Index>::value,"Index must be an unsigned integer type");
+
+public:
+
+	using node_type = fibonacci_compact_node<K,T,Index>;
+	using index_type = Index;
+	using pool_type = Pool<node_type>;
+
+	/** \brief the index that refers to no element */
+	static constexpr Index nil = node_type::nil;
+
+private:
+
+	pool_type pool;
+
+	/** \brief scratch space of consolidate(), trees[d] is the root of degree d, or nil */
+	std::vector<Index> trees;
+
+	node_type &at(Index i) { return pool.nodes()[i]; }
+	const node_type &at(Index i) const { return pool.nodes()[i]; }
+	fibonacci_compact_meta<Index> &meta() { return pool.meta(); }
+	const fibonacci_compact_meta<Index> &meta() const { return pool.meta(); }
+
+	bool compare(Index a,Index b) const { return Compare()(at(a).key,at(b).key); }
+
+	void check_writable() const {
+		if(!pool.writable()) throw "this Fibonacci heap is read-only";
+	}
+
+	void check_index(Index i) const {
+		if(!contains(i)) throw "the given index is not in this Fibonacci heap";
+	}
+
+	/** \brief merge the circular list starting at x into the circular list starting at list */
+	void splice(Index &list,Index x) {
+		if(x==nil) return;
+		if(list==nil) {
+			list = x;
+			return;
+		}
+		Index ar = at(list).right;
+		Index br = at(x).right;
+		at(list).right = br;
+		at(br).left = list;
+		at(x).right = ar;
+		at(ar).left = x;
+	}
+
+	/** \brief take node x out of its sibling list and its parent */
+	void unlink(Index x) {
+		node_type &n = at(x);
+		if(n.parent!=nil) {
+			node_type &p = at(n.parent);
+			p.bits--;
+			if(p.degree()==0)
+				p.child = nil;
+			else if(p.child==x)
+				p.child = n.right;
+			n.parent = nil;
+		}
+		at(n.left).right = n.right;
+		at(n.right).left = n.left;
+		n.left = n.right = x;
+	}
+
+	/** \brief put a single node x into the root list and update min */
+	void add_root(Index x) {
+		Index &min = meta().min;
+		splice(min,x);
+		if(compare(x,min))
+			min = x;
+	}
+
+	/** \brief make root x a child of root p */
+	void link(Index x,Index p) {
+		node_type &n = at(x);
+		n.parent = p;
+		n.bits &= ~node_type::childcut_bit;
+		splice(at(p).child,x);
+		at(p).bits++;
+	}
+
+	/** \brief cut the subtree of x and put it into the root list */
+	void cut(Index x) {
+		unlink(x);
+		at(x).bits &= ~node_type::childcut_bit;
+		add_root(x);
+	}
+
+	/** \brief cut p and its marked ancestors after p lost a child */
+	void cascading_cut(Index p) {
+		while(at(p).parent!=nil) {
+			if(!at(p).childcut()) {
+				at(p).bits |= node_type::childcut_bit;
+				return;
 			}
-			// output edges
-			oss << std::get<1>(traverse_output) << "}";
+			Index pp = at(p).parent;
+			cut(p);
+			p = pp;
 		}
-		return oss.str();
 	}
+
+	/** \brief move all the children of x into the root list */
+	void promote_children(Index x) {
+		node_type &n = at(x);
+		Index c = n.child;
+		if(c==nil) return;
+		Index i = c;
+		do {
+			at(i).parent = nil;
+			i = at(i).right;
+		} while(i!=c);
+		n.child = nil;
+		n.bits &= node_type::childcut_bit;
+		splice(meta().min,c);
+	}
+
+	/** \brief point min to the minimum root by scanning the root list */
+	void find_min() {
+		Index &min = meta().min;
+		Index start = min;
+		Index i = start;
+		do {
+			if(compare(i,min))
+				min = i;
+			i = at(i).right;
+		} while(i!=start);
+	}
+
+	/** \brief set a key not larger than the current one, and cut the element from its parent if needed */
+	void decrease(Index i,K key) {
+		at(i).key = std::move(key);
+		Index p = at(i).parent;
+		if(p==nil) {
+			if(compare(i,meta().min))
+				meta().min = i;
+		} else if(compare(i,p)) {
+			cut(i);
+			cascading_cut(p);
+		}
+	}
+
+	/** \brief set a larger key, moving the children of the element to the root list and cutting it from its parent */
+	void increase(Index i,K key) {
+		bool was_min = (i==meta().min);
+		at(i).key = std::move(key);
+		promote_children(i);
+		Index p = at(i).parent;
+		if(p!=nil) {
+			cut(i);
+			cascading_cut(p);
+		} else if(was_min)
+			find_min();
+	}
+
+	/** \brief meld roots with the same degree until all degrees are distinct, and find the new min */
+	void consolidate() {
+		Index &min = meta().min;
+		size_t max_degree = 0;
+		while(min!=nil) {
+			Index q = min;
+			min = at(q).right==q ? nil : at(q).right;
+			unlink(q);
+			size_t d = at(q).degree();
+			while(true) {
+				if(trees.size()<=d)
+					trees.resize(d+1,nil);
+				Index other = trees[d];
+				if(other==nil)
+					break;
+				trees[d] = nil;
+				if(compare(other,q))
+					std::swap(q,other);
+				link(other,q);
+				d++;
+			}
+			trees[d] = q;
+			max_degree = std::max(max_degree,d);
+		}
+		for(size_t d=0;d<=max_degree&&d<trees.size();d++) {
+			if(trees[d]==nil) continue;
+			splice(min,trees[d]);
+			if(compare(trees[d],min))
+				min = trees[d];
+			trees[d] = nil;
+		}
+	}
+
+	/** \brief get an unused node, growing the pool if needed */
+	Index allocate() {
+		fibonacci_compact_meta<Index> &m = meta();
+		if(m.free!=nil) {
+			Index i = m.free;
+			m.free = at(i).right;
+			return i;
+		}
+		if(m.used>=nil) throw "too many elements for the index type of this Fibonacci heap";
+		if(m.used==pool.capacity())
+			pool.reserve(std::max<size_t>(16,std::min<uint64_t>(2*m.used,nil)));
+		return Index(meta().used++);
+	}
+
+	/** \brief return node x to the free list */
+	void deallocate(Index x) {
+		fibonacci_compact_meta<Index> &m = meta();
+		at(x).left = nil;
+		at(x).right = m.free;
+		m.free = x;
+	}
+
+public:
+
+	/** \brief Create a heap on the pool constructed from the given arguments. */
+	template <typename... Args>
+	explicit basic_compact_fibonacci_heap(Args&&... args):pool(std::forward<Args>(args)...) {}
+
+	basic_compact_fibonacci_heap(const basic_compact_fibonacci_heap &) = delete;
+	basic_compact_fibonacci_heap(basic_compact_fibonacci_heap &&) = default;
+	basic_compact_fibonacci_heap &operator=(const basic_compact_fibonacci_heap &) = delete;
+	basic_compact_fibonacci_heap &operator=(basic_compact_fibonacci_heap &&) = default;
+
+	/** \brief Return the pool of nodes. */
+	const pool_type &get_pool() const { return pool; }
+
+	/** \brief Return the number of elements stored. */
+	size_t size() const { return meta().size; }
+
+	/** \brief Test whether an index refers to an element of this heap.
+	 * @param i the index to test
+	 * @return true if i refers to an element of this heap
+	 */
+	bool contains(Index i) const { return i<meta().used && at(i).left!=nil; }
+
+	/** \brief Return the key of an element.
+	 * @param i the index of the element, must be in this heap
+	 */
+	const K &key(Index i) const { check_index(i); return at(i).key; }
+
+	/** \brief Return the data of an element.
+	 * @param i the index of the element, must be in this heap
+	 */
+	const T &data(Index i) const { check_index(i); return at(i).data; }
+
+	/** \brief Return the data of an element, to be modified in place.
+	 * @param i the index of the element, must be in this heap
+	 */
+	T &data(Index i) {
+		check_writable();
+		check_index(i);
+		return at(i).data;
+	}
+
+	/** \brief Insert an element.
+	 * @param key the key of the element
+	 * @param data the data of the element
+	 * @return the index of the new element, valid until the element is removed
+	 */
+	Index insert(K key,T data) {
+		check_writable();
+		Index i = allocate();
+		node_type &n = at(i);
+		n.key = std::move(key);
+		n.data = std::move(data);
+		n.parent = n.child = nil;
+		n.left = n.right = i;
+		n.bits = 0;
+		add_root(i);
+		meta().size++;
+		return i;
+	}
+
+	/** \brief Return the index of the top element. */
+	Index top() const {
+		if(size()==0) throw "this Fibonacci heap is empty";
+		return meta().min;
+	}
+
+	/** \brief Remove the top element.
+	 * @return the key and the data of the removed element
+	 */
+	std::tuple<K,T> pop() {
+		check_writable();
+		if(size()==0) throw "this Fibonacci heap is empty";
+		Index x = meta().min;
+		std::tuple<K,T> ret(std::move(at(x).key),std::move(at(x).data));
+		promote_children(x);
+		meta().min = at(x).right==x ? nil : at(x).right;
+		unlink(x);
+		deallocate(x);
+		meta().size--;
+		consolidate();
+		return ret;
+	}
+
+	/** \brief Descrease the key of an element.
+	 * @param i the index of the element, must be in this heap
+	 * @param key the new key, must not be larger than the current key
+	 */
+	void decrease_key(Index i,K key) {
+		check_writable();
+		check_index(i);
+		if(Compare()(at(i).key,key)) throw "increase_key is not supported";
+		decrease(i,std::move(key));
+	}
+
+	/** \brief Change the key of an element, in either direction.
+	 *
+	 * A larger key is handled as in fibonacci_heap::update_key(): the children
+	 * of the element are moved to the root list and it is cut from its parent,
+	 * so the index stays valid.
+	 *
+	 * @param i the index of the element, must be in this heap
+	 * @param key the new key
+	 */
+	void update_key(Index i,K key) {
+		check_writable();
+		check_index(i);
+		if(Compare()(at(i).key,key))
+			increase(i,std::move(key));
+		else
+			decrease(i,std::move(key));
+	}
+
+	/** \brief Remove an element.
+	 * @param i the index of the element, must be in this heap
+	 */
+	void remove(Index i) {
+		check_writable();
+		check_index(i);
+		if(i==meta().min) {
+			pop();
+			return;
+		}
+		Index p = at(i).parent;
+		// the children are not less than i, so they are not less than min either
+		promote_children(i);
+		unlink(i);
+		deallocate(i);
+		meta().size--;
+		if(p!=nil)
+			cascading_cut(p);
+	}
+};
+
+// nil is bound to references by std::min and std::vector::resize, before C++17
+// that needs a definition
+template <typename K, typename T, typename Compare, typename Index, template <typename> class Pool>
+constexpr Index basic_compact_fibonacci_heap<K,T,Compare,Index,Pool>::nil;
+
+/** \brief A pool of basic_compact_fibonacci_heap that keeps its nodes in a std::vector
+ *
+ * @param Node the type of nodes
+ */
+template <typename Node>
+class fibonacci_vector_pool {
+
+	std::vector<Node> storage;
+	fibonacci_compact_meta<typename Node::index_type> state;
+
+public:
+
+	/** \brief Create a pool with room for the given number of nodes. */
+	explicit fibonacci_vector_pool(size_t capacity=0):storage(capacity) {}
+
+	/** \brief Take the nodes of another pool, leaving it empty. */
+	fibonacci_vector_pool(fibonacci_vector_pool &&other):storage(std::move(other.storage)),state(other.state) {
+		other.storage.clear();
+		other.state = fibonacci_compact_meta<typename Node::index_type>();
+	}
+
+	fibonacci_vector_pool &operator=(fibonacci_vector_pool &&other) {
+		if(this==&other) return *this;
+		storage = std::move(other.storage);
+		state = other.state;
+		other.storage.clear();
+		other.state = fibonacci_compact_meta<typename Node::index_type>();
+		return *this;
+	}
+
+	fibonacci_compact_meta<typename Node::index_type> &meta() { return state; }
+	const fibonacci_compact_meta<typename Node::index_type> &meta() const { return state; }
+
+	Node *nodes() { return storage.data(); }
+	const Node *nodes() const { return storage.data(); }
+
+	size_t capacity() const { return storage.size(); }
+
+	bool writable() const { return true; }
+
+	void reserve(size_t n) {
+		if(n>storage.size())
+			storage.resize(n);
+	}
+};
+
+/** \brief A Fibonacci heap with small nodes in a contiguous array
+ *
+ * This is basic_compact_fibonacci_heap on a std::vector. Elements are identified
+ * by 32-bit indices by default, and the degree and the childcut mark of a node
+ * share one byte, so a node takes sizeof(K)+sizeof(T)+4*sizeof(Index)+1 bytes
+ * plus padding, 28 bytes for int keys and int data. Compared with fibonacci_heap,
+ * there is no allocation per element, and no node object to keep an element
+ * alive, so an index must not be used after its element is removed. See
+ * basic_compact_fibonacci_heap for the operations of fibonacci_heap it lacks.
+ *
+ * @param K the type for keys, must be default constructible
+ * @param T the type for data, must be default constructible
+ * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Index the unsigned integer type for indices, which limits the number of elements
+ */
+template <typename K, typename T, typename Compare=std::less<K>, typename Index=uint32_t>
+class compact_fibonacci_heap:public basic_compact_fibonacci_heap<K,T,Compare,Index,fibonacci_vector_pool> {
+public:
+
+	/** \brief Create an empty heap.
+	 * @param capacity number of elements to make room for in advance
+	 */
+	explicit compact_fibonacci_heap(size_t capacity=0)
+		:basic_compact_fibonacci_heap<K,T,Compare,Index,fibonacci_vector_pool>(capacity) {}
 };
 
 #endif
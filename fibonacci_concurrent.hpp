@@ -0,0 +1,747 @@
+#ifndef _CPP_FIBONACCI_CONCURRENT_
+#define _CPP_FIBONACCI_CONCURRENT_
+
+/** \file fibonacci_concurrent.hpp
+ * \brief Fibonacci heaps shared by threads, link with -pthread.
+ */
+
+#include "fibonacci.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <random>
+
+/** \brief A Fibonacci heap that many threads can insert into at the same time
+ *
+ * Insertions don't go to the heap directly, but to one of several buffers, each
+ * of which is a small fibonacci_heap behind its own mutex. Each thread sticks to
+ * one buffer, and only moves to another one if its buffer is busy, so producers
+ * on different threads rarely wait for each other. Before looking at the top,
+ * the consumer melds every non-empty buffer into the main heap in O(1) time, so
+ * the cost of the buffers is paid once per buffer, not once per element.
+ *
+ * Insertion is not lock-free: the buffers are sharded behind mutexes. A buffer
+ * is kept as a fibonacci_heap rather than a lock-free list of elements, so that
+ * the consumer takes it in O(1) with meld() instead of inserting its elements
+ * one by one, and linking a node into the doubly linked root list can not be
+ * done with a single atomic operation. The mutexes are mostly uncontended, as
+ * each thread sticks to its buffer and skips busy ones with try_lock(), and a
+ * producer holds one only for an insertion into a small heap.
+ *
+ * Consumers are serialized by a mutex. Elements have no node object, since a
+ * node object can't be shared between threads; use fibonacci_heap directly if
+ * decrease_key() is needed.
+ *
+ * @param K the type for keys
+ * @param T the type for data
+ * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Allocator the allocator of nodes, must be thread safe
+ */
+template <typename K, typename T, typename Compare=std::less<K>, typename Allocator=std::allocator<T>>
+class concurrent_fibonacci_heap {
+
+	using heap_t = fibonacci_heap<K,T,Compare,Allocator>;
+
+	/** \brief a buffer of insertions, on a cache line of its own */
+	struct alignas(64) buffer {
+		std::mutex lock;
+		heap_t heap;
+		explicit buffer(const Allocator &alloc):heap(alloc) {}
+	};
+
+	std::vector<std::unique_ptr<buffer>> buffers;
+	/** \brief number of elements in the buffers */
+	std::atomic<size_t> pending{0};
+	/** \brief number of elements in the buffers and in the main heap */
+	std::atomic<size_t> count{0};
+
+	std::mutex consumer;
+	heap_t heap;
+
+	/** \brief the buffer a thread tries first, threads are spread over buffers in turn */
+	size_t home() const {
+		static std::atomic<size_t> next{0};
+		static thread_local size_t slot = next++;
+		return slot%buffers.size();
+	}
+
+	/** \brief lock the home buffer of this thread, or any free one if it is busy */
+	buffer &acquire() {
+		size_t h = home();
+		for(size_t i=0;i<buffers.size();i++) {
+			buffer &b = *buffers[(h+i)%buffers.size()];
+			if(b.lock.try_lock()) return b;
+		}
+		buffers[h]->lock.lock();
+		return *buffers[h];
+	}
+
+	/** \brief insert an element into a buffer, f inserts into the heap of the buffer */
+	template <typename F>
+	void buffered(F f) {
+		buffer &b = acquire();
+		try {
+			f(b.heap);
+		} catch(...) {
+			b.lock.unlock();
+			throw;
+		}
+		// counted under the lock, so that drain() never takes more than was counted
+		pending.fetch_add(1,std::memory_order_release);
+		count.fetch_add(1,std::memory_order_relaxed);
+		b.lock.unlock();
+	}
+
+	/** \brief meld all the buffers into the main heap, the consumer lock must be held */
+	void drain() {
+		if(pending.load(std::memory_order_acquire)==0) return;
+		for(auto &b:buffers) {
+			std::lock_guard<std::mutex> guard(b->lock);
+			size_t n = b->heap.size();
+			if(n==0) continue;
+			heap.meld(b->heap);
+			pending.fetch_sub(n,std::memory_order_relaxed);
+		}
+	}
+
+public:
+
+	/** \brief Create an empty heap.
+	 * @param n number of insertion buffers, 0 for twice the number of hardware threads
+	 * @param alloc the allocator of nodes
+	 */
+	explicit concurrent_fibonacci_heap(size_t n=0,const Allocator &alloc=Allocator()):heap(alloc) {
+		if(n==0)
+			n = 2*std::max(1u,std::thread::hardware_concurrency());
+		for(size_t i=0;i<n;i++)
+			buffers.emplace_back(new buffer(alloc));
+	}
+
+	concurrent_fibonacci_heap(const concurrent_fibonacci_heap &) = delete;
+	concurrent_fibonacci_heap &operator=(const concurrent_fibonacci_heap &) = delete;
+
+	/** \brief Return the number of elements stored, including those inserted but not yet seen by consumers. */
+	size_t size() const { return count.load(std::memory_order_relaxed); }
+
+	/** \brief Return the number of insertion buffers. */
+	size_t buffer_count() const { return buffers.size(); }
+
+	/** \brief Insert an element, can be called by any number of threads at the same time.
+	 * @param key the key of the element
+	 * @param data the data of the element
+	 */
+	void insert(K key,const T &data) {
+		buffered([&](heap_t &h){ h.insert(std::move(key),data); });
+	}
+
+	/** \brief Insert an element, can be called by any number of threads at the same time.
+	 * @param key the key of the element
+	 * @param data the data of the element
+	 */
+	void insert(K key,T &&data) {
+		buffered([&](heap_t &h){ h.insert(std::move(key),std::move(data)); });
+	}
+
+	/** \brief Insert an element constructing its data in place, can be called by any number of threads at the same time.
+	 * @param key the key of the element
+	 * @param args the arguments to construct the data
+	 */
+	template <typename... Args>
+	void emplace(K key,Args&&... args) {
+		buffered([&](heap_t &h){ h.emplace(std::move(key),std::forward<Args>(args)...); });
+	}
+
+	/** \brief Copy out the top element.
+	 *
+	 * All the elements whose insertion returned before this call are taken into account.
+	 *
+	 * @param key set to the key of the top element
+	 * @param data set to the data of the top element
+	 * @return false if the heap is empty, then key and data are untouched
+	 */
+	bool try_top(K &key,T &data) {
+		std::lock_guard<std::mutex> guard(consumer);
+		drain();
+		if(heap.size()==0) return false;
+		typename heap_t::node n = heap.top();
+		key = n.key();
+		data = n.data();
+		return true;
+	}
+
+	/** \brief Remove the top element.
+	 *
+	 * All the elements whose insertion returned before this call are taken into account.
+	 *
+	 * @param key set to the key of the removed element
+	 * @param data set to the data of the removed element
+	 * @return false if the heap is empty, then key and data are untouched
+	 */
+	bool try_pop(K &key,T &data) {
+		std::lock_guard<std::mutex> guard(consumer);
+		drain();
+		if(heap.size()==0) return false;
+		typename heap_t::node n = heap.remove();
+		count.fetch_sub(1,std::memory_order_relaxed);
+		key = n.key();
+		data = std::move(n.data());
+		return true;
+	}
+
+	/** \brief Remove the top element.
+	 * @return the key and the data of the removed element
+	 */
+	std::tuple<K,T> pop() {
+		std::lock_guard<std::mutex> guard(consumer);
+		drain();
+		if(heap.size()==0) throw "this Fibonacci heap is empty";
+		typename heap_t::node n = heap.remove();
+		count.fetch_sub(1,std::memory_order_relaxed);
+		return std::tuple<K,T>(n.key(),std::move(n.data()));
+	}
+};
+
+/** \brief A relaxed priority queue made of many Fibonacci heaps (a MultiQueue)
+ *
+ * The elements are spread over c*threads shards, each of which is a
+ * fibonacci_heap behind its own mutex. An insertion goes to a random shard
+ * that is not locked. A removal looks at two random unlocked shards and takes
+ * the top of the one with the smaller top. Threads then rarely wait for each
+ * other, at the price of order: the removed element is not always the global
+ * top, but with high probability it is close to it, which is enough for
+ * algorithms like parallel shortest paths or branch and bound. When the heap
+ * holds few elements and random shards keep coming up empty, a removal scans
+ * all the shards instead.
+ *
+ * insert() returns a handle, which remembers the shard of its element, so
+ * decrease_key() only locks that shard. Handles lock their shard whenever they
+ * are copied or destroyed, because the node objects inside are not thread safe,
+ * and they must not outlive the heap.
+ *
+ * @param K the type for keys
+ * @param T the type for data
+ * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Allocator the allocator of nodes, must be thread safe
+ */
+template <typename K, typename T, typename Compare=std::less<K>, typename Allocator=std::allocator<T>>
+class multi_fibonacci_heap {
+
+	using heap_t = fibonacci_heap<K,T,Compare,Allocator>;
+
+	/** \brief a shard, on a cache line of its own */
+	struct alignas(64) shard {
+		std::mutex lock;
+		heap_t heap;
+		explicit shard(const Allocator &alloc):heap(alloc) {}
+	};
+
+	std::vector<std::unique_ptr<shard>> shards;
+	std::atomic<size_t> count{0};
+
+	/** \brief a random shard, each thread has its own random engine */
+	size_t random_shard() const {
+		static std::atomic<unsigned> seeds{0};
+		static thread_local std::minstd_rand rng(++seeds);
+		return rng()%shards.size();
+	}
+
+	/** \brief lock a random shard that is not locked by others, return its index */
+	size_t acquire() {
+		while(true) {
+			size_t i = random_shard();
+			if(shards[i]->lock.try_lock()) return i;
+		}
+	}
+
+	/** \brief remove the top of a locked shard */
+	void pop_locked(shard &s,K &key,T &data) {
+		typename heap_t::node n = s.heap.remove();
+		count.fetch_sub(1,std::memory_order_relaxed);
+		key = n.key();
+		data = std::move(n.data());
+	}
+
+	/** \brief the shard with the better top, nullptr if both are empty */
+	static shard *better(shard &a,shard &b) {
+		if(a.heap.size()==0) return b.heap.size() ? &b : nullptr;
+		if(b.heap.size()==0) return &a;
+		return Compare()(b.heap.top().key(),a.heap.top().key()) ? &b : &a;
+	}
+
+public:
+
+	/** \brief A handle to an element, which can be used to decrease its key */
+	class handle {
+
+		friend class multi_fibonacci_heap;
+
+		multi_fibonacci_heap *owner = nullptr;
+		size_t index = 0;
+		typename heap_t::node n;
+
+		std::mutex &lock() const { return owner->shards[index]->lock; }
+
+		handle(multi_fibonacci_heap *owner,size_t index,typename heap_t::node n):owner(owner),index(index),n(std::move(n)) {}
+
+	public:
+
+		/** \brief Create a handle that refers to nothing. */
+		handle() = default;
+
+		handle(const handle &other):owner(other.owner),index(other.index) {
+			if(!owner) return;
+			std::lock_guard<std::mutex> guard(lock());
+			n = other.n;
+		}
+
+		handle(handle &&other):owner(other.owner),index(other.index),n(std::move(other.n)) { other.owner = nullptr; }
+
+		handle &operator=(handle other) {
+			std::swap(owner,other.owner);
+			std::swap(index,other.index);
+			std::swap(n,other.n);
+			return *this;
+		}
+
+		~handle() {
+			if(!owner) return;
+			std::lock_guard<std::mutex> guard(lock());
+			n = typename heap_t::node();
+		}
+
+		/** \brief Return the shard of the element. */
+		size_t shard_index() const { return index; }
+	};
+
+	/** \brief Create an empty heap.
+	 * @param threads number of threads expected to use the heap, 0 for the number of hardware threads
+	 * @param c number of shards per thread
+	 * @param alloc the allocator of nodes
+	 */
+	explicit multi_fibonacci_heap(size_t threads=0,size_t c=2,const Allocator &alloc=Allocator()) {
+		if(threads==0)
+			threads = std::max(1u,std::thread::hardware_concurrency());
+		size_t n = std::max<size_t>(2,c*threads);
+		for(size_t i=0;i<n;i++)
+			shards.emplace_back(new shard(alloc));
+	}
+
+	multi_fibonacci_heap(const multi_fibonacci_heap &) = delete;
+	multi_fibonacci_heap &operator=(const multi_fibonacci_heap &) = delete;
+
+	/** \brief Return the number of elements stored. */
+	size_t size() const { return count.load(std::memory_order_relaxed); }
+
+	/** \brief Return the number of shards. */
+	size_t shard_count() const { return shards.size(); }
+
+	/** \brief Insert an element into a random shard.
+	 * @param key the key of the element
+	 * @param data the data of the element
+	 * @return a handle to the element
+	 */
+	handle insert(K key,T data) {
+		size_t i = acquire();
+		shard &s = *shards[i];
+		std::lock_guard<std::mutex> guard(s.lock,std::adopt_lock);
+		handle h(this,i,s.heap.insert(std::move(key),std::move(data)));
+		count.fetch_add(1,std::memory_order_relaxed);
+		return h;
+	}
+
+	/** \brief Insert an element into a random shard, without a handle.
+	 * @param key the key of the element
+	 * @param data the data of the element
+	 */
+	void push(K key,T data) {
+		shard &s = *shards[acquire()];
+		std::lock_guard<std::mutex> guard(s.lock,std::adopt_lock);
+		s.heap.insert(std::move(key),std::move(data));
+		count.fetch_add(1,std::memory_order_relaxed);
+	}
+
+	/** \brief Descrease the key of an element, locking only its shard.
+	 * @param h the handle of the element, which must still be in this heap
+	 * @param key the new key, must not be larger than the current key
+	 */
+	void decrease_key(const handle &h,K key) {
+		if(h.owner!=this) throw "the given handle does not belong to this Fibonacci heap";
+		std::lock_guard<std::mutex> guard(h.lock());
+		shards[h.index]->heap.decrease_key(h.n,std::move(key));
+	}
+
+	/** \brief Remove the better of the tops of two random shards.
+	 * @param key set to the key of the removed element
+	 * @param data set to the data of the removed element
+	 * @return false if the heap is empty, then key and data are untouched
+	 */
+	bool try_pop(K &key,T &data) {
+		// give up on random shards after this many pairs are found locked or empty
+		for(size_t attempts=0;attempts<shards.size();attempts++) {
+			if(size()==0) return false;
+			size_t i = random_shard(), j = random_shard();
+			if(i==j) j = (j+1)%shards.size();
+			shard &a = *shards[i], &b = *shards[j];
+			if(!a.lock.try_lock()) continue;
+			if(!b.lock.try_lock()) {
+				a.lock.unlock();
+				continue;
+			}
+			shard *s = better(a,b);
+			if(s)
+				pop_locked(*s,key,data);
+			a.lock.unlock();
+			b.lock.unlock();
+			if(s) return true;
+		}
+		size_t start = random_shard();
+		for(size_t i=0;i<shards.size();i++) {
+			shard &s = *shards[(start+i)%shards.size()];
+			std::lock_guard<std::mutex> guard(s.lock);
+			if(s.heap.size()==0) continue;
+			pop_locked(s,key,data);
+			return true;
+		}
+		return false;
+	}
+};
+
+/** \brief A thread pool that runs tasks in the order of their deadlines, with work stealing
+ *
+ * Each worker thread owns a fibonacci_heap of tasks keyed by deadline, behind a
+ * mutex of its own, and always runs the task of the earliest deadline in its
+ * heap. Tasks submitted by a worker go to its own heap, tasks submitted by other
+ * threads go to a random worker. There is no lock shared by all the workers, so
+ * the priority is only honoured within each worker.
+ *
+ * An idle worker steals from a random other worker whose lock is free: it takes
+ * whole trees of the victim with fibonacci_heap::split(), about half of the tasks
+ * of the victim, without comparing any deadline, and melds them into its own heap
+ * in O(1) time. Once a removal has consolidated the victim into a single tree,
+ * the subtrees below its top are taken. If the victim has a single task, that
+ * task is taken instead. Workers with nothing to steal go to sleep until a task is
+ * submitted.
+ *
+ * Tasks must not throw. The destructor waits for all the tasks to finish.
+ *
+ * @param Deadline the type for deadlines, with default value std::chrono::steady_clock::time_point
+ * @param Compare the class that define the order of deadlines, with default value the "<".
+ */
+template <typename Deadline=std::chrono::steady_clock::time_point, typename Compare=std::less<Deadline>>
+class fibonacci_executor {
+
+	using task = std::function<void()>;
+	using heap_t = fibonacci_heap<Deadline,task,Compare>;
+
+	/** \brief the tasks of a worker, on a cache line of its own */
+	struct alignas(64) worker {
+		std::mutex lock;
+		heap_t heap;
+	};
+
+	std::vector<std::unique_ptr<worker>> workers;
+	std::vector<std::thread> threads;
+
+	/** \brief number of tasks waiting in the heaps */
+	std::atomic<size_t> queued{0};
+	/** \brief number of tasks submitted but not finished */
+	std::atomic<size_t> unfinished{0};
+	std::atomic<size_t> steals{0};
+	std::atomic<bool> stopping{false};
+
+	/** \brief idle workers sleep on this, submit() only wakes them if there are sleepers */
+	std::mutex idle_lock;
+	std::condition_variable idle;
+	std::atomic<size_t> sleepers{0};
+
+	std::mutex done_lock;
+	std::condition_variable done;
+
+	/** \brief the executor and the index of the worker running on this thread, if any */
+	static std::pair<const fibonacci_executor *,size_t> &current() {
+		static thread_local std::pair<const fibonacci_executor *,size_t> c(nullptr,0);
+		return c;
+	}
+
+	size_t random_worker() const {
+		static std::atomic<unsigned> seeds{0};
+		static thread_local std::minstd_rand rng(++seeds);
+		return rng()%workers.size();
+	}
+
+	/** \brief take the task of the earliest deadline from worker w */
+	bool pop(worker &w,task &t) {
+		std::lock_guard<std::mutex> guard(w.lock);
+		if(w.heap.size()==0) return false;
+		typename heap_t::node n = w.heap.remove();
+		t = std::move(n.data());
+		queued--;
+		return true;
+	}
+
+	/** \brief steal tasks from a random worker other than self into the heap of self */
+	bool steal(size_t self,task &t) {
+		size_t n = workers.size();
+		if(n<2) return false;
+		size_t start = random_worker();
+		for(size_t i=0;i<n;i++) {
+			size_t v = (start+i)%n;
+			if(v==self) continue;
+			worker &victim = *workers[v];
+			if(!victim.lock.try_lock()) continue;
+			heap_t loot;
+			size_t size = victim.heap.size();
+			if(size>1)
+				victim.heap.split(loot,size/2);
+			victim.lock.unlock();
+			if(loot.size()) {
+				steals++;
+				worker &w = *workers[self];
+				std::lock_guard<std::mutex> guard(w.lock);
+				w.heap.meld(loot);
+				return false;
+			}
+			if(size==1 && pop(victim,t)) {
+				steals++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(size_t self) {
+		current() = std::make_pair(this,self);
+		worker &w = *workers[self];
+		task t;
+		while(true) {
+			// a successful steal fills the heap of self, so pop again
+			if(pop(w,t) || steal(self,t) || pop(w,t)) {
+				t();
+				t = nullptr;
+				if(--unfinished==0) {
+					std::lock_guard<std::mutex> guard(done_lock);
+					done.notify_all();
+				}
+				continue;
+			}
+			// the tasks left are being moved or run by others, try again soon
+			if(queued>0 && !stopping) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> guard(idle_lock);
+			sleepers++;
+			idle.wait(guard,[&]{ return queued>0 || stopping; });
+			sleepers--;
+			if(stopping && queued==0) return;
+		}
+	}
+
+public:
+
+	/** \brief Start the worker threads.
+	 * @param n number of worker threads, 0 for the number of hardware threads
+	 */
+	explicit fibonacci_executor(size_t n=0) {
+		if(n==0)
+			n = std::max(1u,std::thread::hardware_concurrency());
+		for(size_t i=0;i<n;i++)
+			workers.emplace_back(new worker);
+		for(size_t i=0;i<n;i++)
+			threads.emplace_back([this,i]{ run(i); });
+	}
+
+	fibonacci_executor(const fibonacci_executor &) = delete;
+	fibonacci_executor &operator=(const fibonacci_executor &) = delete;
+
+	/** \brief Wait for all the tasks, then stop the worker threads. */
+	~fibonacci_executor() {
+		wait();
+		{
+			std::lock_guard<std::mutex> guard(idle_lock);
+			stopping = true;
+		}
+		idle.notify_all();
+		for(std::thread &t:threads)
+			t.join();
+	}
+
+	/** \brief Return the number of worker threads. */
+	size_t worker_count() const { return workers.size(); }
+
+	/** \brief Return the number of tasks submitted but not finished. */
+	size_t pending() const { return unfinished; }
+
+	/** \brief Return the number of successful steals so far. */
+	size_t steal_count() const { return steals; }
+
+	/** \brief Submit a task, can be called by any thread, including the tasks themselves.
+	 * @param deadline the deadline of the task, tasks of earlier deadlines are run first by each worker
+	 * @param f the task
+	 */
+	void submit(Deadline deadline,task f) {
+		const std::pair<const fibonacci_executor *,size_t> &c = current();
+		worker &w = *workers[c.first==this ? c.second : random_worker()];
+		unfinished++;
+		{
+			std::lock_guard<std::mutex> guard(w.lock);
+			w.heap.insert(std::move(deadline),std::move(f));
+			queued++;
+		}
+		if(sleepers>0) {
+			std::lock_guard<std::mutex> guard(idle_lock);
+			idle.notify_one();
+		}
+	}
+
+	/** \brief Block until all the submitted tasks are finished, must not be called by a task. */
+	void wait() {
+		std::unique_lock<std::mutex> guard(done_lock);
+		done.wait(guard,[&]{ return unfinished==0; });
+	}
+};
+
+/** \brief A Fibonacci heap that publishes its top key and size to lock-free readers
+ *
+ * The heap is modified by a single writer thread, or by threads that serialize
+ * themselves, through the functions of this class, and after every modification
+ * the key of the top element and the size are copied into a seqlock. Any number
+ * of other threads can then read them with observe() and published_size()
+ * without any lock and without touching the forest, which they must not do
+ * otherwise. published_size() is wait-free. observe() only retries while the
+ * writer is publishing, and never sees a torn key. The writer never waits for
+ * readers.
+ *
+ * @param K the type for keys, must be trivially copyable
+ * @param T the type for data
+ * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Allocator the allocator of nodes
+ */
+template <typename K, typename T, typename Compare=std::less<K>, typename Allocator=std::allocator<T>>
+class published_fibonacci_heap {
+
+	static_assert(std::is_trivially_copyable<K>::value,"keys of a published Fibonacci heap must be trivially copyable");
+
+public:
+
+	using heap_type = fibonacci_heap<K,T,Compare,Allocator>;
+	using node = typename heap_type::node;
+
+private:
+
+	/** \brief number of words the key is copied into */
+	static constexpr size_t words = (sizeof(K)+sizeof(uint64_t)-1)/sizeof(uint64_t);
+
+	heap_type fh;
+
+	/** \brief odd while the writer is publishing */
+	alignas(64) std::atomic<uint64_t> sequence{0};
+	std::atomic<uint64_t> key_words[words];
+	std::atomic<size_t> count{0};
+
+	void publish() {
+		uint64_t s = sequence.load(std::memory_order_relaxed);
+		sequence.store(s+1,std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		uint64_t buffer[words] = {};
+		if(fh.size()) {
+			K key = fh.top().key();
+			std::memcpy(buffer,&key,sizeof(K));
+		}
+		for(size_t i=0;i<words;i++)
+			key_words[i].store(buffer[i],std::memory_order_relaxed);
+		count.store(fh.size(),std::memory_order_relaxed);
+		sequence.store(s+2,std::memory_order_release);
+	}
+
+	/** \brief publish when leaving a scope, even by an exception */
+	struct publisher {
+		published_fibonacci_heap &p;
+		~publisher() { p.publish(); }
+	};
+
+public:
+
+	/** \brief Create an empty heap.
+	 * @param alloc the allocator of nodes
+	 */
+	explicit published_fibonacci_heap(const Allocator &alloc=Allocator()):fh(alloc) {
+		for(std::atomic<uint64_t> &w:key_words)
+			w.store(0,std::memory_order_relaxed);
+	}
+
+	published_fibonacci_heap(const published_fibonacci_heap &) = delete;
+	published_fibonacci_heap &operator=(const published_fibonacci_heap &) = delete;
+
+	/** \brief Read the published top key and size, can be called by any thread.
+	 * @param key set to the key of the top element, untouched if the heap is empty
+	 * @param size set to the number of elements
+	 * @return false if the heap is empty
+	 */
+	bool observe(K &key,size_t &size) const {
+		uint64_t buffer[words];
+		while(true) {
+			uint64_t s = sequence.load(std::memory_order_acquire);
+			if(s&1) {
+				std::this_thread::yield();
+				continue;
+			}
+			for(size_t i=0;i<words;i++)
+				buffer[i] = key_words[i].load(std::memory_order_relaxed);
+			size = count.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(sequence.load(std::memory_order_relaxed)==s) break;
+		}
+		if(size==0) return false;
+		std::memcpy(&key,buffer,sizeof(K));
+		return true;
+	}
+
+	/** \brief Return the published size, can be called by any thread, wait-free. */
+	size_t published_size() const { return count.load(std::memory_order_relaxed); }
+
+	/** \brief Return the heap for reading, only by the writer. */
+	const heap_type &heap() const { return fh; }
+
+	/** \brief Modify the heap with any function of fibonacci_heap, then publish.
+	 * @param f called with a reference to the heap
+	 * @return what f returns
+	 */
+	template <typename F>
+	auto modify(F f) -> decltype(f(fh)) {
+		publisher p{*this};
+		return f(fh);
+	}
+
+	/** \brief The same as fibonacci_heap::insert(), then publish. */
+	node insert(K key,const T &data) { publisher p{*this}; return fh.insert(std::move(key),data); }
+
+	/** \brief The same as fibonacci_heap::insert(), then publish. */
+	node insert(K key,T &&data) { publisher p{*this}; return fh.insert(std::move(key),std::move(data)); }
+
+	/** \brief The same as fibonacci_heap::emplace(), then publish. */
+	template <typename... Args>
+	node emplace(K key,Args&&... args) { publisher p{*this}; return fh.emplace(std::move(key),std::forward<Args>(args)...); }
+
+	/** \brief The same as fibonacci_heap::remove(), then publish. */
+	node remove() { publisher p{*this}; return fh.remove(); }
+
+	/** \brief The same as fibonacci_heap::remove(node), then publish. */
+	node remove(node n) { publisher p{*this}; return fh.remove(std::move(n)); }
+
+	/** \brief The same as fibonacci_heap::pop(), then publish. */
+	std::tuple<K,T> pop() { publisher p{*this}; return fh.pop(); }
+
+	/** \brief The same as fibonacci_heap::decrease_key(), then publish. */
+	void decrease_key(node n,K key) { publisher p{*this}; fh.decrease_key(std::move(n),std::move(key)); }
+
+	/** \brief The same as fibonacci_heap::update_key(), then publish. */
+	void update_key(node n,K key) { publisher p{*this}; fh.update_key(std::move(n),std::move(key)); }
+
+	/** \brief The same as fibonacci_heap::clear(), then publish. */
+	void clear() { publisher p{*this}; fh.clear(); }
+};
+
+#endif
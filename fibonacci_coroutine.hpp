@@ -0,0 +1,240 @@
+#ifndef _CPP_FIBONACCI_COROUTINE_
+#define _CPP_FIBONACCI_COROUTINE_
+
+/** \file fibonacci_coroutine.hpp
+ * \brief A timer scheduler for C++20 coroutines, requires -std=c++20.
+ */
+
+#include "fibonacci.hpp"
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/** \brief The return type of fire-and-forget coroutines
+ *
+ * A coroutine returning fibonacci_task starts running as soon as it is called,
+ * and its frame is destroyed when it finishes. An exception escaping it calls
+ * std::terminate().
+ */
+struct fibonacci_task {
+	struct promise_type {
+		fibonacci_task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+/** \brief A single-threaded scheduler of coroutines waiting for deadlines
+ *
+ * A coroutine suspends itself with `co_await scheduler.sleep_until(t)`, and its
+ * handle is stored in a fibonacci_heap keyed by t until run_expired() or run()
+ * resumes it. The expression of co_await is true if the deadline was reached,
+ * false if the sleep was cancelled.
+ *
+ * A sleep can be given a token, which can cancel it or move its deadline. Timers
+ * that are mostly cancelled or rescheduled before they fire are cheap: moving a
+ * deadline earlier is a decrease_key() in O(1) amortized time, and a cancelled
+ * sleep is moved to the front in the same way and resumed by the next run, so
+ * that a coroutine is never resumed inside cancel().
+ *
+ * Nothing here is thread safe. The coroutines still waiting are destroyed
+ * with the scheduler.
+ *
+ * @param Clock the clock of deadlines, with default value std::chrono::steady_clock
+ */
+template <typename Clock=std::chrono::steady_clock>
+class fibonacci_scheduler {
+public:
+
+	using clock = Clock;
+	using time_point = typename Clock::time_point;
+	using duration = typename Clock::duration;
+
+	class token;
+
+private:
+
+	/** \brief a suspended coroutine, in the frame of the coroutine */
+	struct waiter {
+		std::coroutine_handle<> handle;
+		token *tok = nullptr;
+		bool cancelled = false;
+	};
+
+	using heap_t = fibonacci_heap<time_point,waiter *>;
+
+	heap_t timers;
+
+	/** \brief the nodes taken out by run_expired(), kept to reuse the memory */
+	std::vector<typename heap_t::node> expired;
+
+	/** \brief disarm the token of a waiter taken out of the heap */
+	static waiter *disarm(waiter *w) {
+		if(w->tok) {
+			w->tok->owner = nullptr;
+			w->tok->n = typename heap_t::node();
+		}
+		return w;
+	}
+
+	/** \brief take the top waiter out of the heap, and disarm its token */
+	waiter *pop() { return disarm(timers.remove().data()); }
+
+public:
+
+	/** \brief A token to cancel or reschedule a sleep
+	 *
+	 * A token is armed from the start of a sleep that was given the token until
+	 * the sleep is cancelled or expires. It can be given to another sleep once
+	 * the coroutine of the last one is resumed, and must outlive the sleeps and
+	 * stay in place.
+	 */
+	class token {
+
+		friend class fibonacci_scheduler;
+
+		fibonacci_scheduler *owner = nullptr;
+		typename heap_t::node n;
+
+	public:
+
+		token() = default;
+		token(const token &) = delete;
+		token &operator=(const token &) = delete;
+
+		/** \brief Test whether a sleep given this token is waiting and not cancelled. */
+		bool armed() const { return owner && !n.data()->cancelled; }
+
+		/** \brief Return the deadline of the waiting sleep, must be armed. */
+		time_point deadline() const {
+			if(!armed()) throw "this timer token is not armed";
+			return n.key();
+		}
+
+		/** \brief Cancel the waiting sleep, the coroutine will be resumed by the next run with false.
+		 * @return false if the token is not armed
+		 */
+		bool cancel() {
+			if(!armed()) return false;
+			n.data()->cancelled = true;
+			owner->timers.decrease_key(n,time_point::min());
+			return true;
+		}
+
+		/** \brief Move the deadline of the waiting sleep, earlier or later.
+		 * @param t the new deadline
+		 * @return false if the token is not armed
+		 */
+		bool reschedule(time_point t) {
+			if(!armed()) return false;
+			owner->timers.update_key(n,t);
+			return true;
+		}
+	};
+
+	/** \brief The awaitable returned by sleep_until() */
+	class sleeper {
+
+		friend class fibonacci_scheduler;
+
+		fibonacci_scheduler &owner;
+		time_point deadline;
+		token *tok;
+		waiter w;
+
+		sleeper(fibonacci_scheduler &owner,time_point deadline,token *tok):owner(owner),deadline(deadline),tok(tok) {}
+
+	public:
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> h) {
+			if(tok && tok->owner) throw "this timer token is already armed";
+			w.handle = h;
+			w.tok = tok;
+			typename heap_t::node n = owner.timers.insert(deadline,&w);
+			if(tok) {
+				tok->owner = &owner;
+				tok->n = std::move(n);
+			}
+		}
+
+		bool await_resume() const noexcept { return !w.cancelled; }
+	};
+
+	fibonacci_scheduler() = default;
+	fibonacci_scheduler(const fibonacci_scheduler &) = delete;
+	fibonacci_scheduler &operator=(const fibonacci_scheduler &) = delete;
+
+	/** \brief Destroy the coroutines still waiting. */
+	~fibonacci_scheduler() {
+		while(timers.size())
+			pop()->handle.destroy();
+	}
+
+	/** \brief Return the number of waiting coroutines. */
+	size_t pending() const { return timers.size(); }
+
+	/** \brief Return the earliest deadline, if any coroutine is waiting. */
+	std::optional<time_point> next_deadline() {
+		if(timers.size()==0) return std::nullopt;
+		return timers.top().key();
+	}
+
+	/** \brief Suspend the calling coroutine until a deadline.
+	 * @param t the deadline
+	 * @param tok a token to cancel or reschedule this sleep, or nullptr
+	 * @return an awaitable whose co_await is false if the sleep was cancelled
+	 */
+	sleeper sleep_until(time_point t,token *tok=nullptr) { return sleeper(*this,t,tok); }
+
+	/** \brief Suspend the calling coroutine for a duration from now.
+	 * @param d the duration
+	 * @param tok a token to cancel or reschedule this sleep, or nullptr
+	 * @return an awaitable whose co_await is false if the sleep was cancelled
+	 */
+	sleeper sleep_for(duration d,token *tok=nullptr) { return sleeper(*this,Clock::now()+d,tok); }
+
+	/** \brief Resume the coroutines whose deadlines are not after a given time.
+	 *
+	 * All the expired coroutines are taken out of the heap first, by one batch
+	 * removal that consolidates the heap only as often as needed, and then
+	 * resumed in the order of deadlines, so sleeps that the resumed coroutines
+	 * start wait for the next call, even if they have already expired.
+	 *
+	 * @param now the current time
+	 * @param max_batch the largest number of coroutines to resume
+	 * @return the number of coroutines resumed
+	 */
+	size_t run_expired(time_point now=Clock::now(),size_t max_batch=-1) {
+		// taken from the member, so that a resumed coroutine may run timers too
+		std::vector<typename heap_t::node> batch;
+		std::swap(batch,expired);
+		timers.pop_while([&](const time_point &t) { return max_batch && !(now<t) && max_batch--; },std::back_inserter(batch));
+		for(auto &n:batch)
+			disarm(n.data());
+		for(auto &n:batch)
+			n.data()->handle.resume();
+		size_t count = batch.size();
+		batch.clear();
+		std::swap(batch,expired);
+		return count;
+	}
+
+	/** \brief Resume coroutines as their deadlines come, until none is waiting. */
+	void run() {
+		while(std::optional<time_point> t = next_deadline()) {
+			if(Clock::now()<*t)
+				std::this_thread::sleep_until(*t);
+			run_expired();
+		}
+	}
+};
+
+#endif
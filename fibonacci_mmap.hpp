@@ -0,0 +1,209 @@
+#ifndef _CPP_FIBONACCI_MMAP_
+#define _CPP_FIBONACCI_MMAP_
+
+/** \file fibonacci_mmap.hpp
+ * \brief Fibonacci heaps stored in memory-mapped files, requires POSIX.
+ */
+
+#include "fibonacci.hpp"
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** \brief A pool of basic_compact_fibonacci_heap that keeps its nodes in a memory-mapped file
+ *
+ * The file starts with a header holding the state of the heap, followed by the
+ * array of nodes. As nodes link to each other by indices, the file can be mapped
+ * at any address, so reopening an existing heap only maps the file. Pages of the
+ * file are loaded on demand and written back by the operating system, which
+ * keeps only the recently used part of a large heap in memory.
+ *
+ * A pool opened read-only never writes to the file. It follows the growth of
+ * the file when the nodes are accessed, so other processes can open the file
+ * read-only to look at a heap being modified. Nothing is locked, though: a
+ * reader only sees a consistent heap while no writer is in the middle of an
+ * operation. The file is not consistent either after a crash in the middle of
+ * an operation.
+ *
+ * @param Node the type of nodes, must be trivially copyable
+ */
+template <typename Node>
+class fibonacci_mmap_pool {
+
+	static_assert(std::is_trivially_copyable<Node>::value,"keys and data of a memory-mapped Fibonacci heap must be trivially copyable");
+
+	using Index = typename Node::index_type;
+
+	/** \brief the beginning of the file */
+	struct file_header {
+		char magic[8];
+		uint32_t byte_order;
+		uint32_t node_size;
+		uint32_t index_size;
+		uint32_t reserved;
+		/** \brief number of nodes the file has room for */
+		uint64_t capacity;
+		fibonacci_compact_meta<Index> meta;
+	};
+
+	static constexpr char magic[8] = {'F','I','B','M','M','A','P','1'};
+	static constexpr uint32_t byte_order = 0x01020304;
+
+	/** \brief the position of the array of nodes in the file */
+	static constexpr size_t nodes_offset = (sizeof(file_header)+63)/64*64;
+
+	int fd = -1;
+	bool read_only;
+	mutable char *base = nullptr;
+	mutable size_t mapped_capacity = 0;
+
+	static size_t file_size(size_t capacity) { return nodes_offset+capacity*sizeof(Node); }
+
+	file_header *header() const { return reinterpret_cast<file_header *>(base); }
+
+	/** \brief map the first nodes_offset+capacity*sizeof(Node) bytes of the file, replacing the current mapping */
+	void map(size_t capacity) const {
+		int prot = read_only ? PROT_READ : PROT_READ|PROT_WRITE;
+		void *p = ::mmap(nullptr,file_size(capacity),prot,MAP_SHARED,fd,0);
+		if(p==MAP_FAILED) throw "cannot map the file of the Fibonacci heap";
+		if(base)
+			::munmap(base,file_size(mapped_capacity));
+		base = static_cast<char *>(p);
+		mapped_capacity = capacity;
+	}
+
+	/** \brief remap if a writer has grown the file */
+	void follow() const {
+		if(header()->capacity>mapped_capacity)
+			map(header()->capacity);
+	}
+
+	void close() {
+		if(base)
+			::munmap(base,file_size(mapped_capacity));
+		if(fd>=0)
+			::close(fd);
+		base = nullptr;
+		fd = -1;
+	}
+
+	void open(const std::string &path) {
+		fd = ::open(path.c_str(),read_only ? O_RDONLY : O_RDWR|O_CREAT,0644);
+		if(fd<0) throw "cannot open the file of the Fibonacci heap";
+		struct stat st;
+		if(::fstat(fd,&st)!=0) throw "cannot open the file of the Fibonacci heap";
+		if(st.st_size==0) {
+			if(read_only) throw "the file is not a memory-mapped Fibonacci heap";
+			if(::ftruncate(fd,file_size(0))!=0) throw "cannot grow the file of the Fibonacci heap";
+			map(0);
+			file_header *h = header();
+			std::memcpy(h->magic,magic,sizeof(magic));
+			h->byte_order = byte_order;
+			h->node_size = sizeof(Node);
+			h->index_size = sizeof(Index);
+			h->reserved = 0;
+			h->capacity = 0;
+			h->meta = fibonacci_compact_meta<Index>();
+			return;
+		}
+		if(size_t(st.st_size)<file_size(0)) throw "the file is not a memory-mapped Fibonacci heap";
+		map(0);
+		const file_header *h = header();
+		if(std::memcmp(h->magic,magic,sizeof(magic))!=0 || h->byte_order!=byte_order)
+			throw "the file is not a memory-mapped Fibonacci heap";
+		if(h->node_size!=sizeof(Node) || h->index_size!=sizeof(Index))
+			throw "the file holds a Fibonacci heap of different types";
+		if(size_t(st.st_size)<file_size(h->capacity) || h->meta.used>h->capacity || h->meta.size>h->meta.used)
+			throw "the file of the Fibonacci heap is truncated or corrupted";
+		map(h->capacity);
+	}
+
+public:
+
+	/** \brief Open a file, creating an empty heap if it does not exist or is empty.
+	 * @param path path of the file
+	 * @param read_only open the file read-only, then the file must hold a heap already
+	 */
+	fibonacci_mmap_pool(const std::string &path,bool read_only):read_only(read_only) {
+		try {
+			open(path);
+		} catch(...) {
+			close();
+			throw;
+		}
+	}
+
+	fibonacci_mmap_pool(const fibonacci_mmap_pool &) = delete;
+	fibonacci_mmap_pool &operator=(const fibonacci_mmap_pool &) = delete;
+
+	~fibonacci_mmap_pool() { close(); }
+
+	fibonacci_compact_meta<Index> &meta() { return header()->meta; }
+	const fibonacci_compact_meta<Index> &meta() const { return header()->meta; }
+
+	Node *nodes() { return reinterpret_cast<Node *>(base+nodes_offset); }
+	const Node *nodes() const {
+		follow();
+		return reinterpret_cast<const Node *>(base+nodes_offset);
+	}
+
+	size_t capacity() const { return mapped_capacity; }
+
+	bool writable() const { return !read_only; }
+
+	/** \brief Grow the file to hold at least n nodes. */
+	void reserve(size_t n) {
+		if(n<=mapped_capacity) return;
+		if(::ftruncate(fd,file_size(n))!=0) throw "cannot grow the file of the Fibonacci heap";
+		map(n);
+		// readers take the new capacity as the sign that the file has grown
+		header()->capacity = n;
+	}
+
+	/** \brief Write the modified pages back to the file synchronously. */
+	void flush() const {
+		if(::msync(base,file_size(mapped_capacity),MS_SYNC)!=0) throw "cannot write the Fibonacci heap to its file";
+	}
+};
+
+// magic is passed to memcpy and memcmp, so it needs a definition before C++17
+template <typename Node>
+constexpr char fibonacci_mmap_pool<Node>::magic[8];
+
+template <typename Node>
+constexpr uint32_t fibonacci_mmap_pool<Node>::byte_order;
+
+template <typename Node>
+constexpr size_t fibonacci_mmap_pool<Node>::nodes_offset;
+
+/** \brief A Fibonacci heap stored in a memory-mapped file
+ *
+ * The heap lives in the file given to the constructor, and all the changes are
+ * written to the file by the operating system, see fibonacci_mmap_pool. Elements
+ * are identified by indices as in basic_compact_fibonacci_heap, and they stay
+ * valid after the file is reopened. The file can only be opened by programs
+ * using the same K, T and Index on the same kind of machine.
+ *
+ * @param K the type for keys, must be trivially copyable
+ * @param T the type for data, must be trivially copyable
+ * @param Compare the class that define the order of keys, with default value the "<".
+ * @param Index the unsigned integer type for indices, use uint64_t for more than 2^32-1 elements
+ */
+template <typename K, typename T, typename Compare=std::less<K>, typename Index=uint32_t>
+class mapped_fibonacci_heap:public basic_compact_fibonacci_heap<K,T,Compare,Index,fibonacci_mmap_pool> {
+public:
+
+	/** \brief Open the heap stored in a file.
+	 * @param path path of the file, an empty heap is created if it does not exist
+	 * @param read_only open the file read-only, all the modifications will throw
+	 */
+	explicit mapped_fibonacci_heap(const std::string &path,bool read_only=false)
+		:basic_compact_fibonacci_heap<K,T,Compare,Index,fibonacci_mmap_pool>(path,read_only) {}
+
+	/** \brief Write the heap to its file synchronously. */
+	void flush() const { this->get_pool().flush(); }
+};
+
+#endif
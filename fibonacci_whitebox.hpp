@@ -8,7 +8,7 @@
 #include "fibonacci.hpp"
 
 /** \brief contains tool functions for whitebox test*/
-template <typename K, typename T, typename Compare=std::less<K>>
+template <typename K, typename T, typename Compare=std::less<K>, typename Allocator=std::allocator<T>, typename Stats=fibonacci_no_stats>
 class fibonacci_whitebox {
 
 	// this class is only a container of static methods, creating an object of
@@ -18,13 +18,9 @@ class fibonacci_whitebox {
 public:
 
 	// useful types
-	using fh_t = fibonacci_heap<K,T,Compare>;
-	using sn_t = typename fh_t::internal_structure;
-	using dn_t = typename fh_t::internal_data;
-	using ss_t = std::shared_ptr<sn_t>;
-	using ws_t = std::weak_ptr<sn_t>;
-	using sd_t = std::shared_ptr<dn_t>;
-	using wd_t = std::weak_ptr<dn_t>;
+	using fh_t = fibonacci_heap<K,T,Compare,Allocator,Stats>;
+	using sn_t = typename fh_t::internal_node;
+	using ss_t = sn_t *;
 
 	/** \brief types of inconsistent errors */
 	enum consistency_errors {
@@ -34,8 +30,7 @@ public:
 		null_left_sibling_pointer, ///< left_sibling pointer is nullptr
 		null_right_sibling_pointer, ///< right_sibling pointer is nullptr
 		doubly_linked_list_property_violation, ///< the doubly linked list property is violated
-		null_data_pointer, ///< data pointer is nullptr
-		bad_data_structure_pointer, ///< data node and structure node don't point to each other
+		node_not_in_heap, ///< a node reachable from the forest is not marked as in heap
 		bad_degree, ///< the degree value stored don't match the number of children
 		bad_min_pointer, ///< the min pointer of the Fibonacci heap does not point to the minimum value
 		bad_size, ///< the size information stored don't match the total number of nodes
@@ -69,22 +64,20 @@ private:
 		if (head==nullptr) head = node;
 		// test min-tree property
 		if(parent)
-			if(Compare()(node->data->key,parent->data->key)) throw min_tree_property_violation;
+			if(Compare()(node->key,parent->key)) throw min_tree_property_violation;
 		// test parent and sibling pointers
-		if(node->parent.lock()!=parent) throw wrong_parent_pointer;
-		if(node->left_sibling.expired())
+		if(node->parent!=parent) throw wrong_parent_pointer;
+		if(!node->left_sibling)
 			throw null_left_sibling_pointer;
-		else if(node->left_sibling.lock()->right_sibling!=node)
+		else if(node->left_sibling->right_sibling!=node)
 			throw doubly_linked_list_property_violation;
 		if(!node->right_sibling)
 			throw null_right_sibling_pointer;
-		else if(node->right_sibling->left_sibling.lock()!=node)
+		else if(node->right_sibling->left_sibling!=node)
 			throw doubly_linked_list_property_violation;
-		// test structure and data pointers
-		if(!node->data)
-			throw null_data_pointer;
-		else if(node->data->structure.lock()!=node)
-			throw bad_data_structure_pointer;
+		// test the in heap flag
+		if(!node->in_heap)
+			throw node_not_in_heap;
 		// recursively run test on child and test degree
 		size_t calculated_degree = _data_structure_consistency_test(node->child, node, nullptr);
 		if(node->degree!=calculated_degree) throw bad_degree;
@@ -135,8 +128,8 @@ private:
 
 	/** \brief test if element is in Fibonacci heap */
 	static bool element_in(ss_t e, const fh_t &fh) {
-		while(!e->parent.expired())
-			e = e->parent.lock();
+		while(e->parent)
+			e = e->parent;
 		bool found = false;
 		ss_t p = fh.min;
 		do {
@@ -167,8 +160,8 @@ private:
 			// check if keys and values of different p are the same
 			for(ss_t &p1:ps){
 				for(ss_t &p2:ps){
-					if(p1->data->key!=p2->data->key) return false;
-					if(p1->data->data!=p2->data->data) return false;
+					if(p1->key!=p2->key) return false;
+					if(p1->data!=p2->data) return false;
 				}
 				std::vector<ss_t> children = nodes;
 				for(ss_t &i:children) {
@@ -201,7 +194,7 @@ public:
 	* 1. parent pointer
 	* 2. sibling pointers
 	* 3. degrees
-	* 4. data and structure pointers
+	* 4. in heap flags
 	* 5. min-tree property
 	* 6. min pointer of Fibonacci heap
 	* 7. size
@@ -214,7 +207,7 @@ public:
 		if(fh.min) {
 			for(ss_t p=fh.min->right_sibling; p!=fh.min; p=p->right_sibling) {
 				if(!p) throw unexpected_nullptr;
-				if(Compare()(p->data->key,fh.min->data->key)) throw bad_min_pointer;
+				if(Compare()(p->key,fh.min->key)) throw bad_min_pointer;
 			}
 		}
 		// test for 7
@@ -231,6 +224,21 @@ public:
 		}
 	}
 
+	/** \brief the length of the consolidation scratch of a Fibonacci heap */
+	static size_t scratch_size(const fh_t &fh) { return fh.trees.size(); }
+
+	/** \brief count the roots of a Fibonacci heap */
+	static size_t root_count(const fh_t &fh) {
+		if(!fh.min) return 0;
+		size_t n = 0;
+		ss_t p = fh.min;
+		do {
+			n++;
+			p = p->right_sibling;
+		} while(p!=fh.min);
+		return n;
+	}
+
 	/** \brief test whether the fibonacci_heap object is copied/moved correctly
 	 *
 	 * The following things are tested:
@@ -287,48 +295,43 @@ public:
 	/** \brief test whether the cleanup procedure of a Fibonacci heap works well during descruction
 	 *
 	 * The following things are tested:
-	 * 1. Are all the structure nodes destroyed?
-	 * 2. Are all the data nodes without external reference destroyed?
-	 * 3. Are the reference counts of all the data nodes with external reference decrease by one?
+	 * 1. Are all the nodes detached from the heap?
+	 * 2. Are the reference counts held by node objects kept unchanged?
+	 *
+	 * To be able to inspect nodes after destruction, this method temporarily
+	 * holds one extra reference to every node, and drops it after the test, so
+	 * that nodes without external reference are freed at the end.
 	 *
 	 * @param fhptr the pointer pointing to the Fibonacci heap to be destroyed
 	 */
 	static bool destroy_and_test(std::shared_ptr<fh_t> &fhptr) {
-		std::vector<ws_t> sn_clean_list;
-		std::vector<wd_t> dn_clean_list;
-		using kpl_t = std::tuple<wd_t,int>;
-		std::vector<kpl_t> dn_keep_list;
-		// dump out weak pointers to all the structure and data nodes
+		using kpl_t = std::tuple<ss_t,size_t>;
+		std::vector<kpl_t> keep_list;
+		// dump out pointers to all nodes and hold a reference to them
 		std::function<void (ss_t,ss_t)> traverse = [&](ss_t node,ss_t head) {
 			if(node==head) return;
 			if(head==nullptr) head=node;
-			sn_clean_list.push_back(node);
-			if(node->data.unique())
-				dn_clean_list.push_back(node->data);
-			else
-				dn_keep_list.push_back(make_tuple(node->data,node->data.use_count()));
+			keep_list.push_back(std::make_tuple(node,node->handles));
+			node->handles++;
 			traverse(node->right_sibling,head);
 			traverse(node->child,nullptr);
 		};
 		traverse(fhptr->min,nullptr);
 		// destroy
 		if(!fhptr.unique()) throw "the shared_ptr must be unique in order to do destroy and test";
+		typename fh_t::node_allocator alloc = fhptr->alloc;
 		fhptr.reset();
-		// test for 1
-		for(ws_t &i : sn_clean_list) {
-			if(!i.expired()) return false;
-		}
-		// test for 2
-		for(wd_t &i : dn_clean_list) {
-			if(!i.expired()) return false;
+		bool passed = true;
+		for(kpl_t &i : keep_list) {
+			ss_t node = std::get<0>(i);
+			// test for 1
+			if(node->in_heap) passed = false;
+			// test for 2
+			if(node->handles!=std::get<1>(i)+1) passed = false;
+			// drop the extra reference
+			if(--node->handles==0) fh_t::destroy_node(alloc,node);
 		}
-		// test for 3
-		for(kpl_t &i : dn_keep_list) {
-			if(std::get<0>(i).expired()) return false;
-			if(std::get<0>(i).use_count()!=std::get<1>(i)-1) return false;
-			if(!std::get<0>(i).lock()->structure.expired()) return false;
-		}
-		return true;
+		return passed;
 	}
 };
 
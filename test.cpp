@@ -3,7 +3,19 @@ using namespace std;
 
 #include "test.hpp"
 #include "fibonacci_whitebox.hpp"
+#include "fibonacci_mmap.hpp"
+#include "fibonacci_concurrent.hpp"
+#include "fibonacci_coroutine.hpp"
 #include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <memory_resource>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <array>
 
 /** \brief randomly insert,remove min, meld elements and check if binomial heap
  * properties are maintained after each operation */
@@ -40,6 +52,33 @@ TEST(whitebox,consistency) {
 	}
 }
 
+/** \brief moving a Fibonacci heap keeps its consolidation scratch, so the next remove does not allocate it again */
+TEST(whitebox,move_scratch) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	fh_t fh;
+	for(int i=0;i<1000;i++)
+		fh.insert(i,i);
+	fh.remove();
+	size_t scratch = whitebox::scratch_size(fh);
+	ASSERT_GT(scratch,0);
+	fh_t moved(std::move(fh));
+	ASSERT_EQ(whitebox::scratch_size(moved),scratch);
+	fh_t assigned;
+	assigned = std::move(moved);
+	ASSERT_EQ(whitebox::scratch_size(assigned),scratch);
+	ASSERT_EQ(assigned.remove().key(),1);
+	whitebox::data_structure_consistency_test(assigned);
+	ASSERT_EQ(whitebox::scratch_size(assigned),scratch);
+	// the scratch of an indexed heap is sized once for all the ids
+	indexed_fibonacci_heap<int> ih(1000);
+	for(int i=0;i<1000;i++)
+		ih.push(i,i);
+	indexed_fibonacci_heap<int> ih2(std::move(ih));
+	for(int i=0;i<1000;i++)
+		ASSERT_EQ(ih2.pop(),size_t(i));
+}
+
 /** \brief generate a random Fibonacci heap and test copy and move constructor and assignment operator */
 TEST(whitebox,copy_move) {
 	using eng_t = random_fibonacci_heap_engine<int>;
@@ -130,6 +169,1634 @@ TEST(blackbox,leakage) {
 	}
 }
 
+/** \brief test that node objects keep their elements alive after removal and destruction */
+TEST(blackbox,node_lifetime) {
+	using fh_t = fibonacci_heap<int,instance_count>;
+	fh_t::node removed, kept;
+	{
+		fh_t fh;
+		for(int i=0;i<100;i++)
+			fh.insert(i,instance_count(i));
+		kept = fh.insert(-1,instance_count(-1));
+		removed = fh.remove();
+		ASSERT_TRUE(removed==kept);
+		kept = fh.top();
+		fh.decrease_key(kept,-2);
+		EXPECT_EQ(fh.top().key(),-2);
+	}
+	EXPECT_EQ(removed.key(),-1);
+	EXPECT_EQ(removed.data().value,-1);
+	EXPECT_EQ(kept.key(),-2);
+	EXPECT_EQ(kept.data().value,0);
+	removed = kept;
+	kept = fh_t::node();
+	removed = fh_t::node();
+	for(auto &p : instance_count::n)
+		ASSERT_EQ(p.second,0);
+	instance_count::n.clear();
+}
+
+/** \brief clear a large heap, and check that node objects held by the user survive */
+TEST(blackbox,clear) {
+	using fh_t = fibonacci_heap<int,instance_count>;
+	using whitebox = fibonacci_whitebox<int,instance_count>;
+	fh_t fh;
+	vector<fh_t::node> kept;
+	for(int round=0;round<2;round++) {
+		size_t first = kept.size();
+		for(int i=0;i<1000000;i++) {
+			fh_t::node n = fh.insert(i,instance_count(i));
+			if(i%1000==0) kept.push_back(n);
+		}
+		// build some trees, and cut some nodes so that there are marked nodes
+		fh.remove();
+		for(size_t i=first+1;i<kept.size();i+=2)
+			fh.decrease_key(kept[i],-kept[i].key());
+		fh.clear();
+		ASSERT_EQ(fh.size(),0);
+		ASSERT_THROW(fh.top(),const char *);
+		fh.insert(1,instance_count(1));
+		whitebox::data_structure_consistency_test(fh);
+		ASSERT_EQ(fh.remove().key(),1);
+	}
+	for(size_t i=0;i<kept.size();i++)
+		ASSERT_EQ(kept[i].data().value,(int)(i%(kept.size()/2))*1000);
+	// nodes released by clear() can be inserted again
+	fh.insert(kept[1]);
+	ASSERT_EQ(fh.top().key(),-1000);
+	kept.clear();
+	fh.clear();
+	for(auto &p : instance_count::n)
+		ASSERT_EQ(p.second,0);
+	instance_count::n.clear();
+}
+
+/** \brief run random operations on Fibonacci heaps allocating from an arena and check
+ * consistency and memory leakage */
+TEST(blackbox,arena) {
+	using eng_t = random_fibonacci_heap_engine<instance_count,fibonacci_arena_allocator<instance_count>>;
+	int ntests = 100;
+	int steps = 1000;
+	for(int test_idx=0;test_idx<ntests;test_idx++) {
+		fibonacci_arena arena(1024);
+		{
+			eng_t r(arena);
+			for(int i=0;i<steps;i++) {
+				r.random_step();
+				for(int i:{0,1})
+					if(r.fh[i])
+						eng_t::whitebox::data_structure_consistency_test(*r.fh[i]);
+			}
+		}
+		for(auto &p : instance_count::n)
+			ASSERT_EQ(p.second,0);
+		instance_count::n.clear();
+	}
+}
+
+/** \brief test that nodes freed by remove are reused by later inserts */
+TEST(blackbox,arena_reuse) {
+	fibonacci_arena arena;
+	fibonacci_heap<int,int,std::less<int>,fibonacci_arena_allocator<int>> fh(arena);
+	size_t bytes = 0;
+	for(int round=0;round<10;round++) {
+		for(int i=0;i<10000;i++)
+			fh.insert(i,i);
+		while(fh.size())
+			fh.remove();
+		if(round==0)
+			bytes = arena.allocated_bytes();
+		ASSERT_EQ(arena.allocated_bytes(),bytes);
+	}
+}
+
+/** \brief use std::pmr::polymorphic_allocator, which does not propagate and can not be assigned */
+TEST(blackbox,pmr) {
+	using whitebox = fibonacci_whitebox<int,string,std::less<int>,std::pmr::polymorphic_allocator<string>>;
+	using fh_t = whitebox::fh_t;
+	std::pmr::unsynchronized_pool_resource r1, r2;
+	fh_t a(&r1), b(&r2);
+	vector<fh_t::node> nodes;
+	for(int i=0;i<100;i++) {
+		nodes.push_back(a.insert(i,to_string(i)));
+		b.insert(-i,to_string(-i));
+	}
+	a.remove();
+	b.remove();
+	// node objects of different resources are assigned to each other
+	fh_t::node n = nodes[5];
+	n = b.top();
+	ASSERT_EQ(n.key(),-98);
+	n = nodes[7];
+	ASSERT_EQ(n.data(),"7");
+	nodes.clear();
+	// copy assignment keeps the resource of the target
+	fh_t c(&r1);
+	c = b;
+	ASSERT_EQ(c.get_allocator().resource(),&r1);
+	ASSERT_EQ(c.size(),b.size());
+	whitebox::data_structure_consistency_test(c);
+	ASSERT_THROW(c.meld(b),const char *);
+	// move assignment between different resources moves the elements one by one
+	a = std::move(b);
+	ASSERT_EQ(a.get_allocator().resource(),&r1);
+	ASSERT_EQ(b.size(),0);
+	ASSERT_EQ(a.size(),99);
+	whitebox::data_structure_consistency_test(a);
+	// and takes the nodes when the resources are the same
+	b = fh_t(&r2);
+	fh_t d(&r2);
+	fh_t::node m = d.insert(1,"1");
+	b = std::move(d);
+	b.decrease_key(m,-1000);
+	ASSERT_EQ(b.top().data(),"1");
+	a.meld(c);
+	ASSERT_EQ(a.size(),198);
+	for(int i=-98;i<=0;i++) {
+		ASSERT_EQ(get<1>(a.pop()),to_string(i));
+		ASSERT_EQ(get<1>(a.pop()),to_string(i));
+	}
+	ASSERT_EQ(a.size(),0);
+}
+
+/** \brief build Fibonacci heaps from ranges and check consistency, moving and ordering */
+TEST(blackbox,insert_range) {
+	using fh_t = fibonacci_heap<int,string>;
+	using whitebox = fibonacci_whitebox<int,string>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(-1000,1000);
+	vector<tuple<int,string>> elements;
+	multiset<int> keys;
+	for(int i=0;i<10000;i++) {
+		int k = dist(rng);
+		elements.emplace_back(k,to_string(k));
+		keys.insert(k);
+	}
+	fh_t fh(make_move_iterator(elements.begin()),make_move_iterator(elements.end()));
+	for(auto &e:elements)
+		ASSERT_TRUE(get<1>(e).empty());
+	list<pair<int,string>> more = { {-2000,"-2000"}, {2000,"2000"} };
+	fh.insert_range(more.begin(),more.end());
+	keys.insert(-2000);
+	keys.insert(2000);
+	ASSERT_EQ(fh.size(),keys.size());
+	whitebox::data_structure_consistency_test(fh);
+	for(int k:keys) {
+		fh_t::node n = fh.remove();
+		ASSERT_EQ(n.key(),k);
+		ASSERT_EQ(n.data(),to_string(k));
+		whitebox::data_structure_consistency_test(fh);
+	}
+}
+
+/** \brief test that building from a range allocates all nodes from one block of the arena */
+TEST(blackbox,insert_range_arena) {
+	fibonacci_arena arena(1024);
+	vector<tuple<int,int>> elements;
+	for(int i=0;i<10000;i++)
+		elements.emplace_back(i,i);
+	using whitebox = fibonacci_whitebox<int,int,std::less<int>,fibonacci_arena_allocator<int>>;
+	whitebox::fh_t fh(elements.begin(),elements.end(),arena);
+	ASSERT_EQ(arena.allocated_bytes(),elements.size()*fibonacci_arena::chunk_size(sizeof(whitebox::sn_t)));
+	ASSERT_EQ(fh.top().key(),0);
+	ASSERT_EQ(fh.size(),elements.size());
+	whitebox::data_structure_consistency_test(fh);
+}
+
+/** \brief test move-only data with emplace, insert, insert_range and pop */
+TEST(blackbox,move_only) {
+	using fh_t = fibonacci_heap<int,unique_ptr<int>>;
+	fh_t fh;
+	vector<fh_t::node> nodes;
+	for(int i=0;i<100;i+=3) {
+		nodes.push_back(fh.emplace(i,new int(i)));
+		nodes.push_back(fh.insert(i+1,make_unique<int>(i+1)));
+	}
+	vector<tuple<int,unique_ptr<int>>> elements;
+	for(int i=2;i<100;i+=3)
+		elements.emplace_back(i,make_unique<int>(i));
+	fh.insert_range(make_move_iterator(elements.begin()),make_move_iterator(elements.end()));
+	fh.decrease_key(nodes.back(),-1);
+	*nodes.back().data() = -1;
+	fibonacci_whitebox<int,unique_ptr<int>>::data_structure_consistency_test(fh);
+	fh_t::node top = fh.remove();
+	ASSERT_EQ(*top.data(),-1);
+	nodes.clear();
+	for(int i=0;i<100;i++) {
+		tuple<int,unique_ptr<int>> e = fh.pop();
+		ASSERT_EQ(get<0>(e),i);
+		ASSERT_EQ(*get<1>(e),i);
+	}
+	ASSERT_EQ(fh.size(),0);
+}
+
+/** \brief remove elements in batches and compare with a sorted list of keys */
+TEST(blackbox,remove_batch) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,100000);
+	uniform_int_distribution<int> batch(0,200);
+	fh_t fh;
+	multiset<int> keys;
+	vector<fh_t::node> nodes;
+	for(int round=0;round<100;round++) {
+		for(int i=0;i<1000;i++) {
+			int k = dist(rng);
+			nodes.push_back(fh.insert(k,k));
+			keys.insert(k);
+		}
+		// decrease some keys so that the trees are not binomial
+		for(int i=0;i<100;i++) {
+			fh_t::node n = nodes[uniform_int_distribution<size_t>(0,nodes.size()-1)(rng)];
+			if(n.data()!=n.key()) continue;
+			keys.erase(keys.find(n.key()));
+			fh.decrease_key(n,n.key()-1);
+			keys.insert(n.key());
+		}
+		nodes.clear();
+		vector<fh_t::node> removed;
+		size_t k = batch(rng);
+		fh.remove_top_k(k,back_inserter(removed));
+		ASSERT_EQ(removed.size(),min(k,keys.size()));
+		whitebox::data_structure_consistency_test(fh);
+		int bound = dist(rng)/10;
+		fh.pop_while([&](int key){ return key<bound; },back_inserter(removed));
+		whitebox::data_structure_consistency_test(fh);
+		for(fh_t::node &n:removed) {
+			ASSERT_EQ(n.key(),*keys.begin());
+			keys.erase(keys.begin());
+		}
+		ASSERT_TRUE(keys.empty()||*keys.begin()>=bound);
+		ASSERT_EQ(fh.size(),keys.size());
+	}
+	vector<fh_t::node> rest;
+	fh.remove_top_k(fh.size()+1,back_inserter(rest));
+	ASSERT_EQ(rest.size(),keys.size());
+	ASSERT_EQ(fh.size(),0);
+	for(fh_t::node &n:rest) {
+		ASSERT_EQ(n.key(),*keys.begin());
+		keys.erase(keys.begin());
+	}
+}
+
+/** \brief extract elements below random bounds and compare with a sorted list of keys */
+TEST(blackbox,extract_below) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,100000);
+	fh_t fh;
+	multiset<int> keys;
+	int bound = 0;
+	for(int round=0;round<200;round++) {
+		vector<fh_t::node> nodes;
+		for(int i=0;i<1000;i++) {
+			int k = bound+dist(rng);
+			nodes.push_back(fh.insert(k,k));
+			keys.insert(k);
+		}
+		// consolidate the trees
+		fh_t::node top = fh.remove();
+		ASSERT_EQ(top.key(),*keys.begin());
+		keys.erase(keys.begin());
+		for(int i=0;i<200;i++) {
+			fh_t::node n = nodes[uniform_int_distribution<size_t>(0,nodes.size()-1)(rng)];
+			if(n==top||n.data()!=n.key()) continue;
+			keys.erase(keys.find(n.key()));
+			fh.decrease_key(n,n.key()-dist(rng)/10);
+			keys.insert(n.key());
+		}
+		nodes.clear();
+		bound += dist(rng)/2;
+		vector<fh_t::node> removed;
+		fh.extract_below(bound,back_inserter(removed));
+		whitebox::data_structure_consistency_test(fh);
+		multiset<int> removed_keys;
+		for(fh_t::node &n:removed) {
+			ASSERT_LT(n.key(),bound);
+			removed_keys.insert(n.key());
+		}
+		multiset<int> expected(keys.begin(),keys.lower_bound(bound));
+		ASSERT_EQ(removed_keys,expected);
+		keys.erase(keys.begin(),keys.lower_bound(bound));
+		ASSERT_EQ(fh.size(),keys.size());
+		if(fh.size()) {
+			ASSERT_EQ(fh.top().key(),*keys.begin());
+		}
+	}
+}
+
+/** \brief run Dijkstra's algorithm with indexed_fibonacci_heap and fibonacci_heap and compare */
+TEST(blackbox,indexed) {
+	size_t n = 2000;
+	default_random_engine rng(0);
+	uniform_int_distribution<size_t> vertex(0,n-1);
+	uniform_int_distribution<long> weight(1,1000);
+	vector<vector<tuple<size_t,long>>> adj(n);
+	for(size_t i=0;i<8*n;i++)
+		adj[vertex(rng)].emplace_back(vertex(rng),weight(rng));
+	long inf = numeric_limits<long>::max();
+	// with fibonacci_heap
+	vector<long> dist1(n,inf);
+	{
+		using fh_t = fibonacci_heap<long,size_t>;
+		fh_t fh;
+		vector<fh_t::node> nodes(n);
+		dist1[0] = 0;
+		nodes[0] = fh.insert(0,0);
+		while(fh.size()) {
+			size_t u = fh.remove().data();
+			for(auto &e:adj[u]) {
+				size_t v = get<0>(e);
+				long d = dist1[u]+get<1>(e);
+				if(d>=dist1[v]) continue;
+				if(dist1[v]==inf)
+					nodes[v] = fh.insert(d,v);
+				else
+					fh.decrease_key(nodes[v],d);
+				dist1[v] = d;
+			}
+		}
+	}
+	// with indexed_fibonacci_heap
+	vector<long> dist2(n,inf);
+	indexed_fibonacci_heap<long> ih(n);
+	ASSERT_EQ(ih.capacity(),n);
+	for(int pass=0;pass<2;pass++) {
+		fill(dist2.begin(),dist2.end(),inf);
+		dist2[0] = 0;
+		ih.push(0,0);
+		ASSERT_THROW(ih.push(0,0),const char *);
+		while(ih.size()) {
+			size_t u = ih.top();
+			ASSERT_EQ(ih.key(u),dist2[u]);
+			ASSERT_EQ(ih.pop(),u);
+			ASSERT_FALSE(ih.contains(u));
+			for(auto &e:adj[u]) {
+				size_t v = get<0>(e);
+				long d = dist2[u]+get<1>(e);
+				if(d>=dist2[v]) continue;
+				if(ih.contains(v))
+					ih.decrease_key(v,d);
+				else
+					ih.push(v,d);
+				dist2[v] = d;
+			}
+		}
+		ASSERT_EQ(dist1,dist2);
+	}
+	// remove some ids and check the order of the others
+	for(size_t i=0;i<n;i++)
+		ih.push(i,weight(rng));
+	for(size_t i=0;i<n;i+=3)
+		ih.remove(i);
+	long last = 0;
+	size_t count = 0;
+	while(ih.size()) {
+		size_t id = ih.pop();
+		ASSERT_NE(id%3,0);
+		ASSERT_LE(last,ih.key(id));
+		last = ih.key(id);
+		count++;
+	}
+	ASSERT_EQ(count,n-(n+2)/3);
+}
+
+/** \brief copy a large heap with a mapping of node objects, and use the mapped nodes on the copy */
+TEST(blackbox,copy_mapping) {
+	using fh_t = fibonacci_heap<int,int,std::less<int>,fibonacci_arena_allocator<int>>;
+	using whitebox = fibonacci_whitebox<int,int,std::less<int>,fibonacci_arena_allocator<int>>;
+	fibonacci_arena arena;
+	fh_t fh{fibonacci_arena_allocator<int>(arena)};
+	vector<fh_t::node> nodes;
+	// a long root list, then some trees with cut nodes
+	for(int i=0;i<1000000;i++)
+		nodes.push_back(fh.insert(i,i));
+	fh.remove();
+	for(int i=1;i<1000000;i+=3)
+		fh.decrease_key(nodes[i],nodes[i].key()-10);
+	for(int i=0;i<1000000;i++)
+		nodes.push_back(fh.insert(i,i+1000000));
+	vector<fh_t::node> copied(nodes.size());
+	size_t count = 0;
+	fh_t fh2 = fh.copy([&](const fh_t::node &o,const fh_t::node &n) {
+		ASSERT_EQ(o.key(),n.key());
+		ASSERT_EQ(o.data(),n.data());
+		copied[n.data()] = n;
+		count++;
+	});
+	ASSERT_EQ(count,fh.size());
+	ASSERT_EQ(fh2.size(),fh.size());
+	ASSERT_TRUE(fh2.get_allocator()==fh.get_allocator());
+	// the consistency test recurses along the root list, so consolidate first
+	ASSERT_EQ(fh.remove().key(),fh2.remove().key());
+	whitebox::data_structure_consistency_test(fh2);
+	// mapped nodes work on the copy, and the original is not affected
+	for(int i=2;i<2000000;i+=5)
+		fh2.decrease_key(copied[i],copied[i].key()-20);
+	fh2.remove();
+	whitebox::data_structure_consistency_test(fh2);
+	for(int i=1;i<2000000;i++)
+		ASSERT_EQ(nodes[i].key(),(i<1000000)?(i%3==1?i-10:i):i-1000000);
+	for(int i=0;i<1000;i++) {
+		fh_t::node a = fh.remove(), b = fh2.remove();
+		ASSERT_GE(a.key(),b.key());
+	}
+}
+
+/** \brief run random operations on a snapshot and on a deep copy, and check that
+ * they agree and the base heap is not changed */
+TEST(blackbox,snapshot) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,100000);
+	uniform_int_distribution<int> op(0,5);
+	for(int test_idx=0;test_idx<100;test_idx++) {
+		fh_t fh;
+		vector<fh_t::node> nodes;
+		for(int i=0;i<1000;i++)
+			nodes.push_back(fh.insert(dist(rng),i));
+		multiset<int> base_keys;
+		for(auto &n:nodes)
+			base_keys.insert(n.key());
+		if(test_idx%2)
+			base_keys.erase(base_keys.find(fh.remove().key()));
+		map<int,fh_t::node> ref_nodes;
+		fh_t ref = fh.copy([&](const fh_t::node &,const fh_t::node &n) { ref_nodes[n.data()] = n; });
+		fh_t::overlay s = fh.snapshot();
+		ASSERT_EQ(s.size(),fh.size());
+		// nodes alive in both the snapshot and ref, and their positions by data
+		vector<fh_t::node> alive;
+		unordered_map<int,size_t> where;
+		auto add = [&](const fh_t::node &n) {
+			where[n.data()] = alive.size();
+			alive.push_back(n);
+		};
+		// equal keys may be taken out in different orders, then both elements are dropped
+		auto drop = [&](int data) {
+			auto it = where.find(data);
+			if(it==where.end()) return;
+			size_t idx = it->second;
+			where.erase(it);
+			if(idx+1<alive.size()) {
+				alive[idx] = alive.back();
+				where[alive[idx].data()] = idx;
+			}
+			alive.pop_back();
+		};
+		for(auto &n:nodes)
+			if(ref_nodes.count(n.data()))
+				add(n);
+		int next = nodes.size();
+		for(int step=0;step<300;step++) {
+			ASSERT_EQ(s.size(),ref.size());
+			if(ref.size()==0) break;
+			ASSERT_EQ(s.top().key(),ref.top().key());
+			int o = op(rng);
+			if(alive.empty() && o>=3) o = 0;
+			fh_t::node n, r;
+			if(o>=3) {
+				n = alive[uniform_int_distribution<size_t>(0,alive.size()-1)(rng)];
+				r = ref_nodes[n.data()];
+			}
+			switch(o) {
+			case 0: {
+				int k = dist(rng);
+				add(s.insert(k,next));
+				ref_nodes[next] = ref.insert(k,next);
+				next++;
+				break;
+			}
+			case 1: {
+				tuple<int,int> a = s.pop(), b = ref.pop();
+				ASSERT_EQ(get<0>(a),get<0>(b));
+				drop(get<1>(a));
+				drop(get<1>(b));
+				break;
+			}
+			case 2: {
+				fh_t::node a = s.remove(), b = ref.remove();
+				ASSERT_EQ(a.key(),b.key());
+				drop(a.data());
+				drop(b.data());
+				break;
+			}
+			case 3:
+				s.remove(n);
+				ref.remove(r);
+				drop(n.data());
+				break;
+			case 4: {
+				int k = r.key()-dist(rng)/10;
+				s.decrease_key(n,k);
+				ref.decrease_key(r,k);
+				break;
+			}
+			case 5: {
+				int k = dist(rng);
+				s.update_key(n,k);
+				ref.update_key(r,k);
+				break;
+			}
+			}
+		}
+		while(ref.size()) {
+			ASSERT_EQ(get<0>(s.pop()),get<0>(ref.pop()));
+		}
+		ASSERT_EQ(s.size(),0);
+		// the base is not changed
+		whitebox::data_structure_consistency_test(fh);
+		ASSERT_EQ(fh.size(),base_keys.size());
+		while(fh.size()) {
+			ASSERT_EQ(fh.remove().key(),*base_keys.begin());
+			base_keys.erase(base_keys.begin());
+		}
+	}
+	// a re-keyed base element taken out through its copy is gone from the snapshot
+	fh_t fh;
+	fh_t::node a = fh.insert(1,1);
+	fh_t::node b = fh.insert(2,2);
+	fh_t::overlay s = fh.snapshot();
+	s.update_key(a,0);
+	ASSERT_EQ(get<1>(s.pop()),1);
+	ASSERT_THROW(s.update_key(a,5),const char *);
+	ASSERT_THROW(s.remove(a),const char *);
+	s.update_key(b,3);
+	ASSERT_EQ(s.size(),1);
+	ASSERT_EQ(s.remove().key(),3);
+	ASSERT_EQ(s.size(),0);
+	// nodes taken out of the snapshot are rejected like in fibonacci_heap
+	fh_t::node c = s.insert(-5,5);
+	s.insert(-4,4);
+	s.insert(-3,3);
+	s.remove(c);
+	ASSERT_THROW(s.remove(c),const char *);
+	ASSERT_EQ(s.size(),2);
+	ASSERT_THROW(s.update_key(c,-10),const char *);
+	ASSERT_EQ(s.top().key(),-4);
+	fh_t::node d = s.remove();
+	ASSERT_THROW(s.update_key(d,-10),const char *);
+	ASSERT_THROW(s.decrease_key(d,-10),const char *);
+	ASSERT_EQ(s.size(),1);
+	ASSERT_EQ(s.top().key(),-3);
+	// snapshots are moved, not copied
+	static_assert(!is_copy_constructible<fh_t::overlay>::value,"snapshots must not be copied");
+	static_assert(!is_copy_assignable<fh_t::overlay>::value,"snapshots must not be copied");
+	fh_t::overlay s2(std::move(s));
+	ASSERT_EQ(s2.size(),1);
+	ASSERT_EQ(get<0>(s2.pop()),-3);
+	ASSERT_EQ(s2.size(),0);
+}
+
+/** \brief run random operations with a consolidation limit and check that the root list stays short */
+TEST(whitebox,consolidation_limit) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,1000000);
+	uniform_int_distribution<int> op(0,9);
+	const size_t limit = 32;
+	// log base phi of the largest size, plus one
+	const size_t bound = limit+30;
+	fh_t fh, other;
+	fh.set_consolidation_limit(limit);
+	ASSERT_EQ(fh.consolidation_limit(),limit);
+	multiset<int> keys;
+	vector<fh_t::node> nodes;
+	for(int i=0;i<100000;i++) {
+		int k = dist(rng);
+		nodes.push_back(fh.insert(k,k));
+		keys.insert(k);
+		ASSERT_LE(whitebox::root_count(fh),bound);
+	}
+	whitebox::data_structure_consistency_test(fh);
+	for(int step=0;step<100000;step++) {
+		fh_t::node n = nodes[uniform_int_distribution<size_t>(0,nodes.size()-1)(rng)];
+		switch(op(rng)) {
+		case 0: case 1: case 2: {
+			int k = dist(rng);
+			nodes.push_back(fh.insert(k,k));
+			keys.insert(k);
+			break;
+		}
+		case 3: case 4: {
+			fh_t::node r = fh.remove();
+			keys.erase(keys.find(r.key()));
+			r.data() = -1;
+			break;
+		}
+		case 5: case 6: case 7:
+			if(n.data()!=n.key()) break;
+			keys.erase(keys.find(n.key()));
+			fh.decrease_key(n,n.key()-dist(rng)/10);
+			keys.insert(n.key());
+			break;
+		case 8:
+			if(n.data()!=n.key()) break;
+			keys.erase(keys.find(n.key()));
+			fh.remove(n);
+			n.data() = -1;
+			break;
+		case 9: {
+			for(int i=0;i<100;i++) {
+				int k = dist(rng);
+				other.insert(k,-1);
+				keys.insert(k);
+			}
+			fh.meld(other);
+			break;
+		}
+		}
+		ASSERT_LE(whitebox::root_count(fh),bound);
+	}
+	whitebox::data_structure_consistency_test(fh);
+	ASSERT_EQ(fh.size(),keys.size());
+	fh_t copy = fh;
+	while(fh.size()) {
+		ASSERT_EQ(fh.remove().key(),*keys.begin());
+		keys.erase(keys.begin());
+		ASSERT_LE(whitebox::root_count(fh),bound);
+	}
+	ASSERT_EQ(copy.consolidation_limit(),limit);
+}
+
+/** \brief count operations with fibonacci_stats */
+TEST(whitebox,counters) {
+	using fh_t = fibonacci_heap<int,int,std::less<int>,std::allocator<int>,fibonacci_stats>;
+	using whitebox = fibonacci_whitebox<int,int,std::less<int>,std::allocator<int>,fibonacci_stats>;
+	static_assert(sizeof(fibonacci_heap<int,int>)<sizeof(fh_t),"fibonacci_no_stats should take no space");
+	fh_t fh;
+	vector<fh_t::node> nodes;
+	for(int i=0;i<1000;i++)
+		nodes.push_back(fh.insert(i,i));
+	ASSERT_EQ(fh.counters().allocations,1000);
+	ASSERT_EQ(fh.counters().consolidations,0);
+	fh.remove();
+	whitebox::data_structure_consistency_test(fh);
+	fibonacci_stats s = fh.counters();
+	ASSERT_EQ(s.consolidations,1);
+	ASSERT_EQ(s.consolidated_roots,999);
+	ASSERT_EQ(s.max_root_list,999);
+	ASSERT_EQ(s.links,999-whitebox::root_count(fh));
+	ASSERT_GE(s.comparisons,s.links);
+	ASSERT_EQ(s.cuts,0);
+	// decreasing every key to below the minimum cuts every non-root node
+	fh.reset_counters();
+	ASSERT_EQ(fh.counters().comparisons,0);
+	size_t roots = whitebox::root_count(fh);
+	for(int i=999;i>0;i--)
+		fh.decrease_key(nodes[i],-i);
+	s = fh.counters();
+	ASSERT_EQ(s.cuts+s.cascading_cuts+roots,999);
+	ASSERT_EQ(whitebox::root_count(fh),999);
+	ASSERT_GT(s.cascading_cuts,0);
+	ASSERT_GE(s.max_cascade_depth,1);
+	// a copy starts with fresh counters, and only counts its own nodes
+	fh_t copy = fh;
+	ASSERT_EQ(copy.counters().allocations,999);
+	ASSERT_EQ(copy.counters().cuts,0);
+	ASSERT_EQ(fh.remove().key(),-999);
+	ASSERT_EQ(fh.counters().consolidations,1);
+}
+
+/** \brief check the statistics of the shape of the forest */
+TEST(blackbox,stats) {
+	using fh_t = fibonacci_heap<int,int>;
+	fh_t fh;
+	fh_t::shape s = fh.stats();
+	ASSERT_EQ(s.size,0);
+	ASSERT_EQ(s.roots,0);
+	ASSERT_EQ(s.height,0);
+	ASSERT_TRUE(s.degrees.empty());
+	auto check_sums = [](const fh_t::shape &s) {
+		size_t nodes = 0, children = 0;
+		for(size_t d=0;d<s.degrees.size();d++) {
+			nodes += s.degrees[d];
+			children += d*s.degrees[d];
+		}
+		ASSERT_EQ(nodes,s.size);
+		ASSERT_EQ(children,s.size-s.roots);
+		ASSERT_LE(s.degrees.size(),s.degree_bound+1);
+		ASSERT_GE(s.bytes,s.size*sizeof(int)*2);
+	};
+	vector<fh_t::node> nodes;
+	for(int i=0;i<1024;i++)
+		nodes.push_back(fh.insert(i,i));
+	fh.remove();
+	// 1023 elements make binomial trees of order 0 to 9
+	s = fh.stats();
+	check_sums(s);
+	ASSERT_EQ(s.roots,10);
+	ASSERT_EQ(s.height,10);
+	ASSERT_EQ(s.marked,0);
+	ASSERT_EQ(s.degrees.size(),10);
+	ASSERT_EQ(s.degrees[0],512);
+	// cut a grandchild of each root, which marks its parent
+	for(int i=1;i<1024;i++) {
+		fh_t::node n = nodes[i];
+		if(n.key()%4==3)
+			fh.decrease_key(n,-i);
+	}
+	s = fh.stats();
+	check_sums(s);
+	ASSERT_GT(s.marked,0);
+	ASSERT_GT(s.roots,10);
+	// a long root list
+	for(int i=0;i<1000000;i++)
+		fh.insert(i,i);
+	s = fh.stats();
+	check_sums(s);
+	ASSERT_GE(s.roots,1000000);
+}
+
+/** \brief save heaps to binary images and load them back */
+TEST(blackbox,save_load) {
+	using fh_t = fibonacci_heap<int,double>;
+	using whitebox = fibonacci_whitebox<int,double>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,1000000);
+	fh_t fh;
+	vector<fh_t::node> nodes;
+	multiset<int> keys;
+	for(int i=0;i<100000;i++) {
+		int k = dist(rng);
+		nodes.push_back(fh.insert(k,k/2.0));
+		keys.insert(k);
+	}
+	keys.erase(keys.find(fh.remove().key()));
+	for(int i=0;i<20000;i++) {
+		fh_t::node n = nodes[uniform_int_distribution<size_t>(0,nodes.size()-1)(rng)];
+		if(n.data()!=n.key()/2.0) continue;
+		keys.erase(keys.find(n.key()));
+		fh.decrease_key(n,n.key()-dist(rng)/100);
+		keys.insert(n.key());
+	}
+	keys.insert(fh.insert(dist(rng),0.5).key());
+	ostringstream os(ios::binary);
+	fh.save(os);
+	string image = os.str();
+	ASSERT_EQ(image.size(),32+fh.size()*(sizeof(int)+sizeof(double)+2));
+	// load into an arena, replacing some contents
+	fibonacci_arena arena;
+	fibonacci_heap<int,double,std::less<int>,fibonacci_arena_allocator<double>> fh2{fibonacci_arena_allocator<double>(arena)};
+	fh2.insert(-1,0);
+	istringstream is(image,ios::binary);
+	fh2.load(is);
+	fibonacci_whitebox<int,double,std::less<int>,fibonacci_arena_allocator<double>>::data_structure_consistency_test(fh2);
+	ASSERT_EQ(fh2.size(),fh.size());
+	ASSERT_EQ(fh2.stats().marked,fh.stats().marked);
+	ASSERT_EQ(fh2.stats().roots,fh.stats().roots);
+	ASSERT_EQ(fh2.stats().degrees,fh.stats().degrees);
+	// saving the loaded heap gives the same image, so the forest is the same
+	ostringstream os2(ios::binary);
+	fh2.save(os2);
+	ASSERT_TRUE(os2.str()==image);
+	// broken images do not change the heap
+	fh_t fh3;
+	fh3.insert(1,1);
+	istringstream truncated(image.substr(0,image.size()-5),ios::binary);
+	ASSERT_THROW(fh3.load(truncated),const char *);
+	// the last node is a leaf, giving it a child makes the image too short
+	string bad = image;
+	bad[image.size()-2] = 1;
+	istringstream broken(bad,ios::binary);
+	ASSERT_THROW(fh3.load(broken),const char *);
+	// the first node must be the min
+	bad = image;
+	int big = 2000000;
+	memcpy(&bad[32],&big,sizeof(int));
+	istringstream unordered(bad,ios::binary);
+	ASSERT_THROW(fh3.load(unordered),const char *);
+	istringstream incompatible(image,ios::binary);
+	fibonacci_heap<int,float> fh4;
+	ASSERT_THROW(fh4.load(incompatible),const char *);
+	ASSERT_EQ(fh3.size(),1);
+	ASSERT_EQ(fh3.top().key(),1);
+	whitebox::data_structure_consistency_test(fh3);
+	// an empty heap
+	ostringstream os3(ios::binary);
+	fh_t().save(os3);
+	istringstream is3(os3.str(),ios::binary);
+	fh3.load(is3);
+	ASSERT_EQ(fh3.size(),0);
+	while(fh2.size()) {
+		ASSERT_EQ(fh2.remove().key(),*keys.begin());
+		keys.erase(keys.begin());
+	}
+}
+
+/** \brief stream buffer that counts and discards characters */
+class counting_buf : public std::streambuf {
+protected:
+	int_type overflow(int_type c) override { n++; return c; }
+	std::streamsize xsputn(const char *, std::streamsize count) override { n += count; return count; }
+public:
+	size_t n = 0;
+};
+
+/** \brief write large heaps in dot format, with and without limits */
+TEST(blackbox,write_dot) {
+	using fh_t = fibonacci_heap<int,int>;
+	fh_t fh;
+	vector<fh_t::node> nodes;
+	for(int i=0;i<1000;i++)
+		nodes.push_back(fh.insert(i,i));
+	fh.remove();
+	for(int i=1;i<1000;i+=7)
+		fh.decrease_key(nodes[i],-i);
+	ostringstream oss;
+	fh.write_dot(oss);
+	ASSERT_EQ(oss.str(),fh.dot());
+	auto count = [](const string &s,const string &sub) {
+		size_t n = 0;
+		for(size_t pos=s.find(sub);pos!=string::npos;pos=s.find(sub,pos+1))
+			n++;
+		return n;
+	};
+	ASSERT_EQ(count(oss.str(),"[label="),999);
+	// limits
+	oss.str("");
+	fh.write_dot(oss,100);
+	ASSERT_EQ(count(oss.str(),"[label="),100);
+	oss.str("");
+	fh.write_dot(oss,-1,1);
+	ASSERT_EQ(count(oss.str(),"rank=same"),fh.stats().roots-1);
+	ASSERT_EQ(count(oss.str(),"[label="),fh.stats().roots);
+	ASSERT_EQ(count(oss.str(),"color=green"),0);
+	oss.str("");
+	fh.write_dot(oss,0);
+	ASSERT_EQ(count(oss.str(),"[label="),0);
+	// a long root list and tall trees do not overflow the stack
+	for(int i=0;i<1000000;i++)
+		fh.insert(i,i);
+	counting_buf buf;
+	ostream os(&buf);
+	fh.write_dot(os);
+	ASSERT_GT(buf.n,1000000*50);
+	fh_t empty;
+	ASSERT_EQ(empty.dot(),"digraph{min->addr0[color=black];addr0[style=invis];}");
+	// a single chain is written in one pass, not one pass for each depth
+	fh_t chain;
+	chain.insert(0,0);
+	chain.insert(1,1);
+	chain.insert(2,2);
+	chain.remove();
+	const int height = 50000;
+	for(int i=2;i<height;i++) {
+		// the new smallest root links with the chain, and its other child is removed
+		chain.insert(-3*i,0);
+		chain.insert(-3*i+1,0);
+		fh_t::node n = chain.insert(-3*i+2,0);
+		chain.remove();
+		chain.remove(n);
+	}
+	ASSERT_EQ(chain.size(),height);
+	ASSERT_EQ(chain.stats().height,height);
+	oss.str("");
+	chain.write_dot(oss);
+	ASSERT_EQ(count(oss.str(),"[label="),height);
+	ASSERT_EQ(count(oss.str(),"rank=same"),0);
+	ASSERT_EQ(count(oss.str(),"color=green"),height-1);
+}
+
+/** \brief update keys in both directions and check that node objects stay valid */
+TEST(blackbox,update_key) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,100000);
+	fh_t fh;
+	vector<fh_t::node> nodes;
+	multiset<int> keys;
+	for(int round=0;round<100;round++) {
+		for(int i=0;i<500;i++) {
+			int k = dist(rng);
+			nodes.push_back(fh.insert(k,nodes.size()));
+			keys.insert(k);
+		}
+		fh_t::node r = fh.remove();
+		keys.erase(keys.find(r.key()));
+		swap(nodes[r.data()],nodes.back());
+		nodes[r.data()].data() = r.data();
+		nodes.pop_back();
+		for(int i=0;i<200;i++) {
+			fh_t::node n = nodes[uniform_int_distribution<size_t>(0,nodes.size()-1)(rng)];
+			int k = dist(rng);
+			keys.erase(keys.find(n.key()));
+			fh.update_key(n,k);
+			keys.insert(k);
+			ASSERT_EQ(n.key(),k);
+		}
+		// increasing the key of the top element
+		fh_t::node top = fh.top();
+		keys.erase(keys.find(top.key()));
+		fh.update_key(top,top.key()+dist(rng));
+		keys.insert(top.key());
+		whitebox::data_structure_consistency_test(fh);
+		ASSERT_EQ(fh.top().key(),*keys.begin());
+		ASSERT_EQ(fh.size(),keys.size());
+	}
+	for(fh_t::node &n:nodes)
+		ASSERT_TRUE(nodes[n.data()]==n);
+	while(fh.size()) {
+		ASSERT_EQ(fh.remove().key(),*keys.begin());
+		keys.erase(keys.begin());
+	}
+	ASSERT_THROW(fh.update_key(nodes.front(),0),const char *);
+}
+
+/** \brief decrease keys in batches and compare with calling decrease_key one by one */
+TEST(blackbox,decrease_keys) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,1000000);
+	fh_t fh1, fh2;
+	vector<fh_t::node> nodes1, nodes2;
+	for(int round=0;round<100;round++) {
+		for(int i=0;i<500;i++) {
+			int k = dist(rng);
+			nodes1.push_back(fh1.insert(k,nodes1.size()));
+			nodes2.push_back(fh2.insert(k,nodes2.size()));
+		}
+		fh_t::node r1 = fh1.remove(), r2 = fh2.remove();
+		ASSERT_EQ(r1.data(),r2.data());
+		// the same node may appear more than once in a batch
+		vector<pair<fh_t::node,int>> batch;
+		for(int i=0;i<300;i++) {
+			size_t idx = uniform_int_distribution<size_t>(0,nodes1.size()-1)(rng);
+			if(nodes1[idx]==r1) continue;
+			int k = nodes2[idx].key()-dist(rng)/100;
+			batch.emplace_back(nodes1[idx],k);
+			fh2.decrease_key(nodes2[idx],k);
+		}
+		fh1.decrease_keys(batch.begin(),batch.end());
+		whitebox::data_structure_consistency_test(fh1);
+		for(size_t i=0;i<nodes1.size();i++)
+			ASSERT_EQ(nodes1[i].key(),nodes2[i].key());
+		ASSERT_EQ(fh1.top().key(),fh2.top().key());
+		// drop removed nodes
+		size_t removed_idx = r1.data();
+		nodes1.erase(nodes1.begin()+removed_idx);
+		nodes2.erase(nodes2.begin()+removed_idx);
+		for(size_t i=0;i<nodes1.size();i++) {
+			nodes1[i].data() = i;
+			nodes2[i].data() = i;
+		}
+	}
+	// a batch with an invalid element is applied up to that element
+	fh_t::node top = fh1.top();
+	int lo = top.key();
+	vector<pair<fh_t::node,int>> bad = { {nodes1.back(),lo-1}, {top,lo+1}, {nodes1.front(),lo-2} };
+	ASSERT_THROW(fh1.decrease_keys(bad.begin(),bad.end()),const char *);
+	whitebox::data_structure_consistency_test(fh1);
+	ASSERT_EQ(fh1.top().key(),lo-1);
+	fh2.decrease_key(nodes2.back(),lo-1);
+	while(fh1.size())
+		ASSERT_EQ(fh1.remove().key(),fh2.remove().key());
+}
+
+/** \brief keep a heap in a file, reopen it, and look at it read-only while it is modified */
+TEST(blackbox,mapped) {
+	using mh_t = mapped_fibonacci_heap<long,int>;
+	string path = "/tmp/fibonacci_test_" + to_string(getpid()) + ".heap";
+	::unlink(path.c_str());
+	ASSERT_THROW(mh_t(path,true),const char *);
+	default_random_engine rng(0);
+	uniform_int_distribution<long> dist(0,1000000);
+	// index -> key, the data of each element is its key when inserted
+	map<uint32_t,long> ref;
+	set<pair<long,uint32_t>> order;
+	{
+		mh_t mh(path);
+		ASSERT_EQ(mh.size(),0);
+		ASSERT_THROW(mh.top(),const char *);
+		for(int i=0;i<200000;i++) {
+			int op = uniform_int_distribution<int>(0,9)(rng);
+			if(op<5 || ref.empty()) {
+				long k = dist(rng);
+				uint32_t id = mh.insert(k,k);
+				ASSERT_EQ(ref.count(id),0);
+				ref[id] = k;
+				order.emplace(k,id);
+			} else if(op<7) {
+				long k = mh.key(mh.top());
+				tuple<long,int> top = mh.pop();
+				ASSERT_EQ(get<0>(top),k);
+				ASSERT_GE(get<1>(top),k);
+				ASSERT_EQ(order.begin()->first,k);
+				ref.erase(order.begin()->second);
+				order.erase(order.begin());
+			} else {
+				auto it = ref.lower_bound(uniform_int_distribution<uint32_t>(0,ref.rbegin()->first)(rng));
+				if(op<9) {
+					long k = it->second-dist(rng)/10;
+					mh.decrease_key(it->first,k);
+					ASSERT_THROW(mh.decrease_key(it->first,k+1),const char *);
+					order.erase(make_pair(it->second,it->first));
+					order.emplace(k,it->first);
+					it->second = k;
+				} else {
+					mh.remove(it->first);
+					ASSERT_FALSE(mh.contains(it->first));
+					order.erase(make_pair(it->second,it->first));
+					ref.erase(it);
+				}
+			}
+			if(i%1000==0) {
+				ASSERT_EQ(mh.size(),ref.size());
+			}
+		}
+		mh.flush();
+	}
+	// reopen and check the indices and the order
+	{
+		mh_t mh(path);
+		ASSERT_EQ(mh.size(),ref.size());
+		for(auto &e:ref) {
+			ASSERT_TRUE(mh.contains(e.first));
+			ASSERT_EQ(mh.key(e.first),e.second);
+			ASSERT_GE(mh.data(e.first),e.second);
+		}
+		ASSERT_THROW(mh_t(path,true).pop(),const char *);
+		{
+			// a reader follows the writer while the file grows
+			mh_t reader(path,true);
+			ASSERT_EQ(reader.key(reader.top()),mh.key(mh.top()));
+			for(int i=0;i<300000;i++) {
+				uint32_t id = mh.insert(-i,-i);
+				ref[id] = -i;
+			}
+			ASSERT_EQ(reader.size(),ref.size());
+			ASSERT_EQ(reader.key(reader.top()),-299999);
+			ASSERT_EQ(reader.top(),mh.top());
+			ASSERT_THROW(reader.data(reader.top()) = 0,const char *);
+			ASSERT_THROW(reader.update_key(reader.top(),0),const char *);
+		}
+		multiset<long> keys;
+		for(auto &e:ref)
+			keys.insert(e.second);
+		for(long k:keys)
+			ASSERT_EQ(get<0>(mh.pop()),k);
+		ASSERT_EQ(mh.size(),0);
+	}
+	// files of other types are refused
+	ASSERT_THROW((mapped_fibonacci_heap<int,int>(path)),const char *);
+	::unlink(path.c_str());
+}
+
+/** \brief random operations on compact_fibonacci_heap, checked against an ordered set */
+TEST(blackbox,compact) {
+	using ch_t = compact_fibonacci_heap<int,uint32_t>;
+	ASSERT_EQ(sizeof(ch_t::node_type),28);
+	ch_t ch(100);
+	ASSERT_EQ(ch.get_pool().capacity(),100);
+	ASSERT_THROW(ch.top(),const char *);
+	ASSERT_THROW(ch.pop(),const char *);
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(-1000000,1000000);
+	// index -> key, the data of each element is the number of insertions before it
+	map<uint32_t,int> ref;
+	set<pair<int,uint32_t>> order;
+	uint32_t inserted = 0;
+	size_t max_size = 0;
+	for(int i=0;i<300000;i++) {
+		int op = uniform_int_distribution<int>(0,10)(rng);
+		if(op<5 || ref.empty()) {
+			int k = dist(rng);
+			uint32_t id = ch.insert(k,inserted++);
+			ASSERT_EQ(ref.count(id),0);
+			ref[id] = k;
+			order.emplace(k,id);
+		} else if(op<7) {
+			// elements of equal keys may be popped in any order
+			uint32_t id = ch.top();
+			ASSERT_EQ(ch.key(id),order.begin()->first);
+			uint32_t data = ch.data(id);
+			tuple<int,uint32_t> top = ch.pop();
+			ASSERT_EQ(get<0>(top),order.begin()->first);
+			ASSERT_EQ(get<1>(top),data);
+			ASSERT_FALSE(ch.contains(id));
+			ASSERT_THROW(ch.key(id),const char *);
+			ref.erase(id);
+			order.erase(make_pair(get<0>(top),id));
+		} else {
+			auto it = ref.lower_bound(uniform_int_distribution<uint32_t>(0,ref.rbegin()->first)(rng));
+			order.erase(make_pair(it->second,it->first));
+			if(op<9) {
+				int k = it->second-dist(rng)%1000-1000;
+				ch.decrease_key(it->first,k);
+				ASSERT_THROW(ch.decrease_key(it->first,k+1),const char *);
+				it->second = k;
+				order.emplace(k,it->first);
+			} else if(op<10) {
+				int k = dist(rng);
+				ch.update_key(it->first,k);
+				ASSERT_EQ(ch.key(it->first),k);
+				it->second = k;
+				order.emplace(k,it->first);
+			} else {
+				ch.remove(it->first);
+				ASSERT_THROW(ch.remove(it->first),const char *);
+				ref.erase(it);
+			}
+		}
+		ASSERT_EQ(ch.size(),ref.size());
+		max_size = max(max_size,ref.size());
+	}
+	// indices of removed elements are reused
+	ASSERT_LE(ch.get_pool().capacity(),2*max_size);
+	// moving takes all the elements
+	ch_t moved(std::move(ch));
+	ASSERT_EQ(ch.size(),0);
+	ASSERT_EQ(moved.size(),ref.size());
+	for(auto &e:order) {
+		ASSERT_EQ(moved.key(moved.top()),e.first);
+		ASSERT_EQ(get<0>(moved.pop()),e.first);
+	}
+	ASSERT_EQ(moved.size(),0);
+	// data can be modified in place
+	uint32_t a = moved.insert(1,10);
+	moved.data(a) += 5;
+	ASSERT_EQ(get<1>(moved.pop()),15);
+	// many equal keys, with keys changed in both directions among them
+	ch_t ties;
+	vector<uint32_t> ids;
+	for(uint32_t i=0;i<10000;i++)
+		ids.push_back(ties.insert(i%3,i));
+	ties.pop();
+	for(uint32_t i=1;i<10000;i+=7)
+		ties.update_key(ids[i],(i%2)?0:2);
+	multiset<uint32_t> left;
+	for(uint32_t i=1;i<10000;i++)
+		left.insert(i);
+	int last = -1;
+	while(ties.size()) {
+		tuple<int,uint32_t> t = ties.pop();
+		ASSERT_GE(get<0>(t),last);
+		last = get<0>(t);
+		ASSERT_EQ(left.erase(get<1>(t)),1);
+	}
+	ASSERT_TRUE(left.empty());
+	// the largest index is reserved for nil, so uint8_t indices hold 255 elements
+	auto overflow = [](auto ch,size_t limit) {
+		for(size_t i=0;i<limit;i++)
+			ch.insert(int(limit-i)%5,0);
+		ASSERT_EQ(ch.size(),limit);
+		ASSERT_THROW(ch.insert(0,0),const char *);
+		ASSERT_EQ(ch.size(),limit);
+		// removed indices are reused at capacity
+		auto top = ch.top();
+		ASSERT_EQ(get<0>(ch.pop()),0);
+		ASSERT_EQ(ch.insert(-1,0),top);
+		ASSERT_THROW(ch.insert(0,0),const char *);
+		int last = -1;
+		while(ch.size()) {
+			int k = get<0>(ch.pop());
+			ASSERT_GE(k,last);
+			last = k;
+		}
+	};
+	overflow(compact_fibonacci_heap<int,int,less<int>,uint8_t>(),255);
+	overflow(compact_fibonacci_heap<int,int,less<int>,uint16_t>(),65535);
+}
+
+/** \brief start a thread running f, counting an exception escaping f in failures
+ * instead of terminating, so that failures are checked after join()
+ */
+template <typename F>
+thread guarded_thread(atomic<int> &failures,F f) {
+	return thread([&failures,f]{
+		try {
+			f();
+		} catch(...) {
+			failures++;
+		}
+	});
+}
+
+/** \brief producers insert into concurrent_fibonacci_heap while consumers remove from it */
+TEST(blackbox,concurrent) {
+	using ch_t = concurrent_fibonacci_heap<long,long>;
+	ch_t ch(4);
+	ASSERT_EQ(ch.buffer_count(),4);
+	long key, data;
+	ASSERT_FALSE(ch.try_pop(key,data));
+	ASSERT_THROW(ch.pop(),const char *);
+	int producers = 8, consumers = 2, per_producer = 20000;
+	atomic<int> running{producers};
+	vector<vector<long>> popped(consumers);
+	vector<thread> threads;
+	atomic<int> failures{0};
+	for(int p=0;p<producers;p++)
+		threads.push_back(guarded_thread(failures,[&,p]{
+			default_random_engine rng(p);
+			uniform_int_distribution<long> dist(0,1000000);
+			for(int i=0;i<per_producer;i++) {
+				long k = dist(rng);
+				ch.insert(k,k+1);
+			}
+			running--;
+		}));
+	for(int c=0;c<consumers;c++)
+		threads.push_back(guarded_thread(failures,[&,c]{
+			long key, data;
+			while(running>0) {
+				if(!ch.try_pop(key,data)) continue;
+				if(data!=key+1) throw "wrong data";
+				popped[c].push_back(key);
+			}
+		}));
+	for(thread &t:threads)
+		t.join();
+	ASSERT_EQ(failures,0);
+	// the elements left are in order
+	vector<long> rest;
+	ASSERT_TRUE(ch.try_top(key,data));
+	while(ch.size()) {
+		tuple<long,long> e = ch.pop();
+		ASSERT_EQ(get<1>(e),get<0>(e)+1);
+		rest.push_back(get<0>(e));
+	}
+	ASSERT_EQ(rest.front(),key);
+	ASSERT_TRUE(is_sorted(rest.begin(),rest.end()));
+	// every element is removed exactly once
+	multiset<long> all(rest.begin(),rest.end()), expected;
+	for(auto &v:popped)
+		all.insert(v.begin(),v.end());
+	for(int p=0;p<producers;p++) {
+		default_random_engine rng(p);
+		uniform_int_distribution<long> dist(0,1000000);
+		for(int i=0;i<per_producer;i++)
+			expected.insert(dist(rng));
+	}
+	ASSERT_EQ(all,expected);
+}
+
+/** \brief threads insert into, decrease keys in and remove from multi_fibonacci_heap */
+TEST(blackbox,multi) {
+	using mh_t = multi_fibonacci_heap<long,long>;
+	mh_t mh(4,2);
+	ASSERT_EQ(mh.shard_count(),8);
+	long key, data;
+	ASSERT_FALSE(mh.try_pop(key,data));
+	// with a single thread, everything comes out exactly once
+	{
+		vector<mh_t::handle> handles;
+		for(long i=0;i<1000;i++)
+			handles.push_back(mh.insert(i,i));
+		mh_t::handle copy = handles[500];
+		mh.decrease_key(copy,-1);
+		ASSERT_THROW(mh.decrease_key(handles[500],0),const char *);
+		set<long> seen;
+		while(mh.try_pop(key,data)) {
+			ASSERT_EQ(key,data==500?-1:data);
+			ASSERT_TRUE(seen.insert(data).second);
+		}
+		ASSERT_EQ(seen.size(),1000);
+		ASSERT_THROW(mh.decrease_key(handles[0],-2),const char *);
+	}
+	int threads = 8, per_thread = 10000;
+	vector<vector<long>> popped(threads);
+	vector<thread> workers;
+	atomic<int> failures{0};
+	for(int t=0;t<threads;t++)
+		workers.push_back(guarded_thread(failures,[&,t]{
+			default_random_engine rng(t);
+			uniform_int_distribution<long> dist(0,1000000);
+			vector<mh_t::handle> handles;
+			long key, data;
+			for(int i=0;i<per_thread;i++) {
+				// data is the id of the element, the key is at most its id
+				long id = long(t)*per_thread+i;
+				handles.push_back(mh.insert(id,id));
+				if(i%3==0) {
+					mh_t::handle h = handles[dist(rng)%handles.size()];
+					try {
+						mh.decrease_key(h,-dist(rng));
+					} catch(const char *) {
+						// the element was removed already, or the key was smaller
+					}
+				}
+				if(i%2==0 && mh.try_pop(key,data))
+					popped[t].push_back(data);
+			}
+		}));
+	for(thread &t:workers)
+		t.join();
+	ASSERT_EQ(failures,0);
+	vector<long> all;
+	for(auto &v:popped)
+		all.insert(all.end(),v.begin(),v.end());
+	ASSERT_EQ(mh.size(),size_t(threads)*per_thread-all.size());
+	while(mh.try_pop(key,data)) {
+		ASSERT_LE(key,data);
+		all.push_back(data);
+	}
+	ASSERT_EQ(mh.size(),0);
+	sort(all.begin(),all.end());
+	ASSERT_EQ(all.size(),size_t(threads)*per_thread);
+	for(size_t i=0;i<all.size();i++)
+		ASSERT_EQ(all[i],long(i));
+}
+
+/** \brief split heaps of various shapes and check both parts */
+TEST(whitebox,split) {
+	using fh_t = fibonacci_heap<int,int>;
+	using whitebox = fibonacci_whitebox<int,int>;
+	default_random_engine rng(0);
+	uniform_int_distribution<int> dist(0,1000000);
+	for(int round=0;round<200;round++) {
+		fh_t fh, other;
+		multiset<int> keys;
+		vector<fh_t::node> nodes;
+		int n = uniform_int_distribution<int>(0,3000)(rng);
+		for(int i=0;i<n;i++) {
+			int k = dist(rng);
+			nodes.push_back(fh.insert(k,k));
+			keys.insert(k);
+			// consolidate now and then, so that there are trees of all sizes
+			if(i%500==499) {
+				keys.erase(keys.find(fh.remove().key()));
+				// cut some nodes, so that the trees are not binomial
+				for(int j=0;j<50;j++) {
+					fh_t::node d = nodes[dist(rng)%nodes.size()];
+					int old = d.key();
+					try {
+						fh.decrease_key(d,old/2);
+					} catch(const char *) {
+						// d was removed
+						continue;
+					}
+					keys.erase(keys.find(old));
+					keys.insert(old/2);
+				}
+			}
+		}
+		size_t wanted = uniform_int_distribution<size_t>(0,fh.size())(rng);
+		int top = fh.size() ? fh.top().key() : 0;
+		size_t total = fh.size();
+		size_t moved = fh.split(other,wanted);
+		ASSERT_EQ(other.size(),moved);
+		ASSERT_EQ(fh.size()+moved,total);
+		if(total) {
+			ASSERT_EQ(fh.top().key(),top);
+		}
+		if(moved<wanted) {
+			ASSERT_EQ(fh.size(),1);
+		}
+		whitebox::data_structure_consistency_test(fh);
+		whitebox::data_structure_consistency_test(other);
+		multiset<int> after;
+		while(fh.size())
+			after.insert(fh.remove().key());
+		while(other.size())
+			after.insert(other.remove().key());
+		ASSERT_EQ(after,keys);
+	}
+	// a consolidated heap is a single tree, whose subtrees are moved
+	fh_t fh, other;
+	for(int i=0;i<9;i++)
+		fh.insert(i,i);
+	fh.remove();
+	ASSERT_EQ(whitebox::root_count(fh),1);
+	size_t moved = fh.split(other,4);
+	ASSERT_GE(moved,4);
+	ASSERT_EQ(fh.size()+moved,8);
+	ASSERT_EQ(fh.top().key(),1);
+	whitebox::data_structure_consistency_test(fh);
+	whitebox::data_structure_consistency_test(other);
+	ASSERT_EQ(fh.split(other,100),7-moved);
+	ASSERT_EQ(fh.size(),1);
+	ASSERT_EQ(fh.split(other,100),0);
+	whitebox::data_structure_consistency_test(fh);
+	whitebox::data_structure_consistency_test(other);
+	for(int i=2;i<9;i++)
+		ASSERT_EQ(other.remove().key(),i);
+}
+
+/** \brief run tasks on fibonacci_executor, in the order of deadlines on a single worker */
+TEST(blackbox,executor) {
+	{
+		fibonacci_executor<int> ex(1);
+		ASSERT_EQ(ex.worker_count(),1);
+		atomic<bool> go{false};
+		vector<int> order;
+		ex.submit(0,[&]{ while(!go) this_thread::yield(); });
+		default_random_engine rng(0);
+		uniform_int_distribution<int> dist(1,1000000);
+		for(int i=0;i<1000;i++) {
+			int d = dist(rng);
+			ex.submit(d,[&order,d]{ order.push_back(d); });
+		}
+		go = true;
+		ex.wait();
+		ASSERT_EQ(ex.pending(),0);
+		ASSERT_EQ(order.size(),1000);
+		ASSERT_TRUE(is_sorted(order.begin(),order.end()));
+	}
+	// all the tasks are spawned on one worker, the others have to steal them
+	atomic<long> sum{0};
+	atomic<int> count{0};
+	{
+		fibonacci_executor<int> ex(4);
+		ex.submit(0,[&]{
+			for(int i=1;i<=20000;i++)
+				ex.submit(i,[&,i]{
+					sum += i;
+					// tasks submitted by tasks go to the same worker
+					if(i%1000==0)
+						ex.submit(-i,[&]{ count++; });
+				});
+		});
+		ex.wait();
+		ASSERT_EQ(ex.pending(),0);
+		ASSERT_EQ(sum,20000L*20001/2);
+		ASSERT_EQ(count,20);
+		ex.submit(1,[&]{ count++; });
+	}
+	// the destructor waits for the tasks
+	ASSERT_EQ(count,21);
+	// a worker steals from a heap consolidated into a single tree by a removal
+	{
+		fibonacci_executor<int> ex(2);
+		atomic<int> arrived{0}, started{0};
+		atomic<bool> spawned{false}, timed_out{false};
+		// spin until cond() holds, giving up after a while instead of hanging
+		auto spin = [&](function<bool()> cond) {
+			auto limit = chrono::steady_clock::now()+chrono::seconds(10);
+			while(!cond())
+				if(chrono::steady_clock::now()>limit) {
+					timed_out = true;
+					return;
+				}
+		};
+		// two holders keep both workers busy, the first one fills its own heap
+		for(int h=0;h<2;h++)
+			ex.submit(0,[&]{
+				bool first = (arrived++==0);
+				spin([&]{ return arrived==2; });
+				if(!first) {
+					spin([&]{ return spawned.load(); });
+					return;
+				}
+				// 2^6+1 tasks, the removal of the first leaves a single tree of 64
+				for(int i=1;i<=65;i++)
+					ex.submit(i,[&,i]{
+						started++;
+						if(i>1) return;
+						spawned = true;
+						spin([&]{ return started>=2; });
+					});
+			});
+		ex.wait();
+		ASSERT_FALSE(timed_out);
+		ASSERT_EQ(started,65);
+		ASSERT_GT(ex.steal_count(),0);
+	}
+}
+
+/** \brief sleep, cancel and reschedule coroutines with fibonacci_scheduler on a virtual clock */
+TEST(blackbox,scheduler) {
+	using sched_t = fibonacci_scheduler<>;
+	using ms = chrono::milliseconds;
+	sched_t::time_point t0;
+	sched_t s;
+	vector<pair<int,bool>> log;
+	sched_t::token tokens[4];
+	auto sleeper = [&](int id,int at) -> fibonacci_task {
+		bool fired = co_await s.sleep_until(t0+ms(at),&tokens[id]);
+		log.emplace_back(id,fired);
+		// sleep again without a token
+		if(fired && id==0) {
+			co_await s.sleep_until(t0+ms(at+5));
+			log.emplace_back(10,true);
+		}
+	};
+	for(int i=0;i<4;i++)
+		sleeper(i,10*(i+1));
+	ASSERT_EQ(s.pending(),4);
+	ASSERT_TRUE(s.next_deadline()==t0+ms(10));
+	ASSERT_TRUE(tokens[2].armed());
+	ASSERT_TRUE(tokens[2].deadline()==t0+ms(30));
+	// 1 moves after 3, 3 moves before 0, 2 is cancelled
+	ASSERT_TRUE(tokens[1].reschedule(t0+ms(50)));
+	ASSERT_TRUE(tokens[3].reschedule(t0+ms(5)));
+	ASSERT_TRUE(tokens[2].cancel());
+	ASSERT_FALSE(tokens[2].armed());
+	ASSERT_FALSE(tokens[2].cancel());
+	ASSERT_EQ(s.run_expired(t0),1);
+	ASSERT_EQ(log,(vector<pair<int,bool>>{{2,false}}));
+	ASSERT_EQ(s.run_expired(t0+ms(4)),0);
+	ASSERT_EQ(s.run_expired(t0+ms(10)),2);
+	ASSERT_FALSE(tokens[0].armed());
+	ASSERT_FALSE(tokens[0].reschedule(t0));
+	ASSERT_THROW(tokens[0].deadline(),const char *);
+	ASSERT_EQ(s.run_expired(t0+ms(100),1),1);
+	ASSERT_EQ(s.run_expired(t0+ms(100)),1);
+	ASSERT_EQ(log,(vector<pair<int,bool>>{{2,false},{3,true},{0,true},{10,true},{1,true}}));
+	ASSERT_EQ(s.pending(),0);
+	ASSERT_FALSE(s.next_deadline());
+	// run() waits for the real clock
+	auto start = chrono::steady_clock::now();
+	int fired = 0;
+	auto short_sleep = [&](int d) -> fibonacci_task {
+		if(co_await s.sleep_for(ms(d)))
+			fired++;
+	};
+	short_sleep(20);
+	short_sleep(10);
+	s.run();
+	ASSERT_EQ(fired,2);
+	ASSERT_GE(chrono::steady_clock::now()-start,ms(20));
+	// coroutines still waiting are destroyed with the scheduler
+	struct probe {
+		int &count;
+		~probe() { count++; }
+	};
+	int destroyed = 0;
+	{
+		// the token must outlive the scheduler, which disarms it
+		sched_t::token tok;
+		sched_t s2;
+		auto waiting = [&](sched_t::token *tok) -> fibonacci_task {
+			probe p{destroyed};
+			co_await s2.sleep_until(t0+ms(1),tok);
+		};
+		waiting(&tok);
+		waiting(nullptr);
+		ASSERT_EQ(s2.pending(),2);
+		ASSERT_EQ(destroyed,0);
+	}
+	ASSERT_EQ(destroyed,2);
+}
+
+/** \brief readers observe the top key and size of published_fibonacci_heap while a writer modifies it */
+TEST(blackbox,published) {
+	// a key of several words, with all the words equal, so that torn reads can be seen
+	using key_t = array<long,3>;
+	using ph_t = published_fibonacci_heap<key_t,int>;
+	ph_t ph;
+	key_t key;
+	size_t size;
+	ASSERT_FALSE(ph.observe(key,size));
+	ASSERT_EQ(size,0);
+	auto make_key = [](long k) { return key_t{k,k,k}; };
+	// the top key is always 1-size: every insertion is below all the others
+	atomic<bool> done{false};
+	atomic<long> observations{0};
+	// readers count bad observations and keep going, so that the writer is not left waiting
+	atomic<long> torn{0}, inconsistent{0};
+	atomic<int> failures{0};
+	vector<thread> readers;
+	for(int r=0;r<3;r++)
+		readers.push_back(guarded_thread(failures,[&]{
+			key_t key;
+			size_t size;
+			while(!done) {
+				if(ph.observe(key,size)) {
+					if(key[0]!=key[1] || key[1]!=key[2])
+						torn++;
+					else if(key[0]!=1-long(size))
+						inconsistent++;
+				}
+				observations++;
+			}
+		}));
+	default_random_engine rng(0);
+	for(int i=0;i<200000;i++) {
+		size_t n = ph.heap().size();
+		if(n==0 || rng()%3) {
+			ph.insert(make_key(-long(n)),i);
+		} else if(rng()%2) {
+			ph.remove();
+		} else {
+			// move the top away and back with modify(), only one publication
+			ph.modify([&](ph_t::heap_type &fh){
+				ph_t::node top = fh.remove();
+				fh.insert(top.key(),top.data());
+			});
+		}
+	}
+	while(observations<1000 && failures<3)
+		this_thread::yield();
+	done = true;
+	for(thread &t:readers)
+		t.join();
+	ASSERT_EQ(failures,0);
+	ASSERT_EQ(torn,0);
+	ASSERT_EQ(inconsistent,0);
+	ASSERT_TRUE(ph.observe(key,size));
+	ASSERT_EQ(size,ph.heap().size());
+	ASSERT_EQ(ph.published_size(),size);
+	ASSERT_TRUE(key==ph.heap().top().key());
+	ph.clear();
+	ASSERT_FALSE(ph.observe(key,size));
+	ASSERT_EQ(ph.published_size(),0);
+}
+
 int main(int argc, char **argv) {
 	testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
@@ -9,14 +9,15 @@
 using namespace std;
 
 /** \brief an engine to do random operations and generate random Fibonacci heaps */
-template <typename val_t>
+template <typename val_t, typename alloc_t=std::allocator<val_t>>
 class random_fibonacci_heap_engine {
 	int count = 0;
 public:
-	using whitebox = fibonacci_whitebox<int,val_t>;
+	using whitebox = fibonacci_whitebox<int,val_t,std::less<int>,alloc_t>;
 	bool verbose = false;
 	bool showdot = false;
-	using fh_t = fibonacci_heap<int,val_t>;
+	using fh_t = fibonacci_heap<int,val_t,std::less<int>,alloc_t>;
+	alloc_t alloc;
 	random_device r;
 	default_random_engine rng;
 	uniform_real_distribution<double> u01 = uniform_real_distribution<double>(0,1);
@@ -25,7 +26,7 @@ public:
 	shared_ptr<fh_t> fh[2];
 	vector<typename fh_t::node> nodes[2];
 
-	random_fibonacci_heap_engine():rng(r()) {}
+	random_fibonacci_heap_engine(alloc_t alloc=alloc_t()):alloc(alloc),rng(r()) {}
 
 	double pnew = 0.1;
 	double pcopy = 0.5;
@@ -75,7 +76,7 @@ public:
 	virtual void initialize(int i) {
 		if(verbose)
 			cout << "fh["  << i << "]" << ".initialize()" << endl;
-		fh[i] = make_shared<fh_t>();
+		fh[i] = make_shared<fh_t>(alloc);
 		while(fh[i]->size()<init_size) {
 			insert(i);
 		}
@@ -102,7 +103,7 @@ public:
 	virtual void create_new(int i) {
 		if(verbose)
 			cout << "fh["  << i << "]" << " = new" << endl;
-		fh[i] = make_shared<fh_t>();
+		fh[i] = make_shared<fh_t>(alloc);
 	}
 
 	/** \brief copy a Fibonacci heap*/